@@ -5,6 +5,8 @@ if /I "%1"=="--profile" set profileEnable=-D_PROFILE_
 if /I "%1"=="/profile" set profileEnable=-D_PROFILE_
 if /I "%2"=="--profile" set profileEnable=-D_PROFILE_
 if /I "%2"=="/profile" set profileEnable=-D_PROFILE_
+if /I "%2"=="--no-profile" set profileEnable=-DPROFILE_LEVEL=0
+if /I "%2"=="/no-profile" set profileEnable=-DPROFILE_LEVEL=0
 
 if /I "%1"=="" goto DEBUG
 if /I "%1"=="--debug" goto DEBUG
@@ -43,10 +45,13 @@ set sourceExe=src\main.cpp
 
 
 set outputExe=-Fdbin\ -Fobuild\ -Febin\rttest.exe
+set sourceBench=src\bench.cpp
+set outputBench=-Fdbin\ -Fobuild\ -Febin\rtbench.exe
 goto BUILD
 
 :BUILD
-cl %compilerFlagsCommon% %compilerFlagsSpecific% %suppressedWarnings% %outputExe% %sourceExe% %linkerFlagsExe% user32.lib Gdi32.lib Winmm.lib
+cl %compilerFlagsCommon% %compilerFlagsSpecific% %suppressedWarnings% %outputExe% %sourceExe% %linkerFlagsExe% user32.lib Gdi32.lib Winmm.lib Ws2_32.lib Psapi.lib
+cl %compilerFlagsCommon% %compilerFlagsSpecific% %suppressedWarnings% %outputBench% %sourceBench% %linkerFlagsExe% user32.lib Gdi32.lib Winmm.lib Ws2_32.lib Psapi.lib
 goto END
 
 :NOCANDO
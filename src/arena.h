@@ -0,0 +1,77 @@
+#pragma once
+
+// Growable arrays that never move. An arena reserves a large range of address space up
+// front and commits pages only as it fills, so everything pushed stays where it is while
+// the arena grows: elements stay contiguous and pointers into it stay valid. Reserving
+// costs address space only, but size the reserve from what the array can actually hold,
+// many arenas of a huge reserve add up quickly.
+//
+// NOTE: not thread safe. Scenes are built on one thread before any render thread starts.
+
+// a page, so small arenas commit little
+#define ARENA_COMMIT_GRANULARITY ((size_t)1<<12)
+
+struct Arena
+{
+	uint8 * base;
+	size_t used;
+	size_t committed;
+	size_t reserved;
+	MemoryTag tag;
+};
+
+bool InitArena(Arena * arena, MemoryTag tag, size_t reserveBytes)
+{
+	*arena = {};
+	arena->base = (uint8*)VirtualAlloc(NULL, reserveBytes, MEM_RESERVE, PAGE_NOACCESS);
+	if(!arena->base)
+	{
+		OutputDebugStringA("Failed to reserve arena!");
+		return false;
+	}
+	arena->reserved = reserveBytes;
+	arena->tag = tag;
+	TRACK_ALLOC(tag, 0); // counted once, the commits only add bytes
+	return true;
+}
+
+void FreeArena(Arena * arena)
+{
+	if(arena->base)
+	{
+		TRACK_FREE(arena->tag, arena->committed);
+		VirtualFree(arena->base, 0, MEM_RELEASE);
+	}
+	*arena = {};
+}
+
+// Returns zeroed memory, freshly committed pages always are and nothing is ever popped.
+// Commits at least half of what is committed already, so large arenas grow in few steps.
+void * PushArena(Arena * arena, size_t bytes, size_t alignment)
+{
+	size_t start = (arena->used + alignment - 1) & ~(alignment - 1);
+	size_t end = start + bytes;
+	if(end > arena->reserved)
+	{
+		OutputDebugStringA("Arena is full!");
+		return nullptr;
+	}
+	if(end > arena->committed)
+	{
+		size_t commit = max(end, arena->committed + arena->committed / 2);
+		commit = (commit + ARENA_COMMIT_GRANULARITY - 1) & ~(ARENA_COMMIT_GRANULARITY - 1);
+		commit = min(commit, arena->reserved);
+		if(!VirtualAlloc(arena->base + arena->committed, commit - arena->committed, MEM_COMMIT, PAGE_READWRITE))
+		{
+			OutputDebugStringA("Failed to commit arena!");
+			return nullptr;
+		}
+		TRACK_GROW(arena->tag, commit - arena->committed);
+		arena->committed = commit;
+	}
+	arena->used = end;
+	return arena->base + start;
+}
+
+#define PUSH_ARRAY(arena, type, count) ((type*)PushArena(arena, sizeof(type) * (count), __alignof(type)))
+#define PUSH_STRUCT(arena, type) PUSH_ARRAY(arena, type, 1)
@@ -0,0 +1,1271 @@
+#include "common.h"
+
+// Headless throughput benchmark. Renders a fixed set of scenes at a fixed resolution
+// and sample count with the same tile jobs and render threads as the viewer, and
+// reports wall time, Mrays/s and samples/s per scene as JSON.
+//
+// NOTE: ray counts come from raystats.h, so they are only there when the build has a
+// profile tier on (the default). A --no-profile build reports wall time and samples/s only.
+//
+// Options:
+//   -threads <n> -json <path> (stdout when not given) -scene <name> (all when not given)
+//   -scene generated renders the scene from the -gen-* options in settings.h
+//   -micro runs the kernel microbenchmarks in microbench.h instead, -kernel <name> picks one
+//   -samplers measures the sample patterns of sampler.h (samplestats.h), -sampler <name> picks one
+//   -converge measures error over time against a reference for -scene (cornell by default),
+//   with -budget <s> -reference <path.pfm> -reference-passes <n>
+//   -scaling sweeps the worker count from 1 to all cores (or -max-threads <n>) on -scene
+//   -repeats <n> renders every scene n times and reports the median and its interval
+//   -save-baseline <path> stores the results, -baseline <path> compares against stored ones
+//   and exits with 2 when a scene got slower by more than -max-slowdown <percent> (5)
+
+#define BENCH_SEED 20190523
+#define MAX_BENCH_REPEATS 64
+
+#include <intrin.h>
+#include "microbench.h"
+#include "samplestats.h"
+
+struct BenchScene
+{
+	const char * name;
+	int width;
+	int height;
+	int samplesPerPixel;
+	int maxDiffuseBounces;
+	int secondaryRays;
+	bool (*build)(Scene * s, Camera * cam);
+};
+
+struct BenchResult
+{
+	double buildSeconds;
+	double renderSeconds;
+	uint objectCount;
+	uint lightCount;
+	uint triangleCount;
+	uint32 sceneHash; // see HashBenchScene
+	RayStats rays; // of one repeat, every repeat traces the same rays
+	int repeatCount;
+	double rates[MAX_BENCH_REPEATS]; // see GetBenchRate
+};
+
+void AddGroundAndSun(Scene * s, float height)
+{
+	Material groundMaterial = {};
+	groundMaterial.diffuse = {0.6f, 0.6f, 0.6f, 1.0f};
+	groundMaterial.rf0 = V4::FromFloat(0.005f);
+	AddPlane(s, {0.0f, 0.0f, height}, {0.0f, 0.0f, 1.0f}, groundMaterial);
+
+	Light * sun = AddLight(s);
+	sun->position = {-20.0f, -30.0f, 60.0f};
+	sun->color = {1.0f, 0.95f, 0.9f, 1.0f};
+	sun->intensity = 4000.0f;
+}
+
+// the scene the viewer renders
+bool BuildCornellScene(Scene * s, Camera * cam)
+{
+	if(!InitScene(s))
+	{
+		return false;
+	}
+	*cam = LookAt({-10.0f, 0.0f, 3.0f}, {0.0f, 0.0f, 3.0f}, 0.35f, 0.28f);
+	return true;
+}
+
+// 100k spheres on a jittered grid, every ray tests all of them
+bool BuildSphereFieldScene(Scene * s, Camera * cam)
+{
+	const int side = 316; // ~100k
+	const float spacing = 1.0f;
+	RNG rng(BENCH_SEED);
+	if(!InitSceneStorage(s))
+	{
+		return false;
+	}
+	AddGroundAndSun(s, 0.0f);
+	for(int y = 0; y < side; ++y)
+	{
+		for(int x = 0; x < side; ++x)
+		{
+			float r = rng.Next(0.15f, 0.45f);
+			float cx = (x - side/2) * spacing + rng.Next(-0.05f, 0.05f);
+			float cy = (y - side/2) * spacing + rng.Next(-0.05f, 0.05f);
+			AddSphere(s, {cx, cy, r}, r, GenerateMaterial(&rng));
+		}
+	}
+	*cam = LookAt({-side * 0.5f - 10.0f, 0.0f, 25.0f}, {0.0f, 0.0f, 0.0f}, 0.35f, 0.28f);
+	return true;
+}
+
+// 1M triangle tessellated sphere. The mesh is split into patches of 1000 triangles,
+// one object each, so the per-object AABB test culls most of it for every ray.
+bool BuildMeshScene(Scene * s, Camera * cam)
+{
+	const int slices = 1000;
+	const int stacks = 500;
+	const int patchSlices = 25;
+	const int patchStacks = 20;
+	const float radius = 4.0f;
+	const V3 center = {0.0f, 0.0f, radius};
+
+	if(!InitSceneStorage(s))
+	{
+		return false;
+	}
+	AddGroundAndSun(s, 0.0f);
+
+	Material mat = {};
+	mat.diffuse = {0.8f, 0.8f, 0.8f, 1.0f};
+	mat.rf0 = V4::FromFloat(0.005f);
+
+	// smooth shaded, each patch shares the vertices along its edges with its neighbours
+	for(int ps = 0; ps < stacks; ps += patchStacks)
+	{
+		for(int pl = 0; pl < slices; pl += patchSlices)
+		{
+			Mesh patch;
+			if(!PushMesh(s, &patch, (patchStacks + 1) * (patchSlices + 1), patchStacks * patchSlices * 2, false))
+			{
+				return false;
+			}
+			for(int st = 0; st <= patchStacks; ++st)
+			{
+				for(int sl = 0; sl <= patchSlices; ++sl)
+				{
+					float theta = PI * (ps + st) / stacks;
+					float phi = PI2 * (pl + sl) / slices;
+					V3 p = V3{sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta)};
+					uint vertex = st * (patchSlices + 1) + sl;
+					patch.positions[vertex] = center + p * radius;
+					SetMeshNormal(&patch, vertex, p);
+				}
+			}
+			uint triangle = 0;
+			for(int st = 0; st < patchStacks; ++st)
+			{
+				for(int sl = 0; sl < patchSlices; ++sl)
+				{
+					uint v00 = st * (patchSlices + 1) + sl;
+					uint v01 = v00 + 1;
+					uint v10 = v00 + patchSlices + 1;
+					uint v11 = v10 + 1;
+					SetMeshTriangle(&patch, triangle++, v00, v10, v01);
+					SetMeshTriangle(&patch, triangle++, v01, v10, v11);
+				}
+			}
+			AddMesh(s, &patch, mat);
+		}
+	}
+	*cam = LookAt({-14.0f, -3.0f, 7.0f}, center, 0.35f, 0.28f);
+	return true;
+}
+
+// the Cornell box lit by 256 point lights, mostly shadow rays
+bool BuildManyLightScene(Scene * s, Camera * cam)
+{
+	if(!InitScene(s))
+	{
+		return false;
+	}
+
+	RNG rng(BENCH_SEED);
+	for(int i = 0; i < 256; ++i)
+	{
+		Light * light = AddLight(s);
+		light->position = {rng.Next(-2.8f, 2.8f), rng.Next(-2.8f, 2.8f), rng.Next(0.2f, 5.8f)};
+		light->color = {rng.Next(0.5f, 1.0f), rng.Next(0.5f, 1.0f), rng.Next(0.5f, 1.0f), 1.0f};
+		light->intensity = 0.5f;
+	}
+	*cam = LookAt({-10.0f, 0.0f, 3.0f}, {0.0f, 0.0f, 3.0f}, 0.35f, 0.28f);
+	return true;
+}
+
+// from the -gen-* options, only run when asked for with -scene generated
+bool BuildGeneratedScene(Scene * s, Camera * cam)
+{
+	if(!IsGeneratedScene(&gSettings.sceneGen))
+	{
+		return false;
+	}
+	return GenerateScene(s, cam, &gSettings.sceneGen);
+}
+
+// One repeat of the suite takes about 15 seconds on a single core, spheres100k is most of
+// it. Baselines repeat every scene 10 times, so budget ten times that for those.
+BenchScene benchScenes[] = {
+	{"cornell", 320, 192, 1, 1, 8*8, BuildCornellScene},
+	{"spheres100k", 160, 96, 1, 0, 1, BuildSphereFieldScene},
+	{"mesh1m", 160, 96, 1, 0, 1, BuildMeshScene},
+	{"manylights", 320, 192, 1, 0, 1, BuildManyLightScene},
+	{"generated", 160, 96, 1, 0, 1, BuildGeneratedScene},
+};
+
+struct BenchSceneData
+{
+	Scene scene;
+	Camera camera;
+	double buildSeconds;
+	uint32 hash; // of the scene content, see HashBenchScene
+};
+
+// FNV-1a
+uint32 HashBytes(uint32 hash, const void * data, size_t size)
+{
+	const uint8 * bytes = (const uint8*)data;
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// Everything that goes into the image: primitives, which object each belongs to, materials,
+// lights and the camera. Identifies cached references and baselines, so a changed scene
+// builder doesn't get compared against stale results.
+uint32 HashBenchScene(BenchSceneData * data)
+{
+	Scene * s = &data->scene;
+	uint32 hash = 2166136261u;
+	hash = HashBytes(hash, s->sphereX, s->sphereCount * sizeof(float));
+	hash = HashBytes(hash, s->sphereY, s->sphereCount * sizeof(float));
+	hash = HashBytes(hash, s->sphereZ, s->sphereCount * sizeof(float));
+	hash = HashBytes(hash, s->sphereRadius, s->sphereCount * sizeof(float));
+	hash = HashBytes(hash, s->sphereObjects, s->sphereCount * sizeof(uint));
+	hash = HashBytes(hash, s->planes, s->planeCount * sizeof(Plane));
+	hash = HashBytes(hash, s->planeObjects, s->planeCount * sizeof(uint));
+	hash = HashBytes(hash, s->meshObjects, s->meshCount * sizeof(uint));
+	for(uint i = 0; i < s->meshCount; ++i)
+	{
+		Mesh * mesh = &s->meshes[i];
+		hash = HashBytes(hash, mesh->positions, mesh->vertexCount * sizeof(V3));
+		hash = HashBytes(hash, mesh->normals, mesh->vertexCount * (mesh->octNormals ? sizeof(uint32) : sizeof(V3)));
+		hash = HashBytes(hash, mesh->indices, 3 * mesh->triangleCount * (mesh->shortIndices ? sizeof(uint16) : sizeof(uint32)));
+	}
+	// field by field, Material has padding
+	for(uint i = 0; i < s->objectCount; ++i)
+	{
+		Material * m = &s->materials[i];
+		hash = HashBytes(hash, &m->diffuse, sizeof(m->diffuse));
+		hash = HashBytes(hash, &m->rf0, sizeof(m->rf0));
+		hash = HashBytes(hash, &m->emissive, sizeof(m->emissive));
+		hash = HashBytes(hash, &m->power, sizeof(m->power));
+		hash = HashBytes(hash, &m->isConductor, sizeof(m->isConductor));
+	}
+	hash = HashBytes(hash, s->lights, s->lightCount * sizeof(Light));
+	hash = HashBytes(hash, &data->camera, sizeof(data->camera));
+	return hash;
+}
+
+bool BuildBenchScene(BenchScene * bench, BenchSceneData * data)
+{
+	*data = {};
+	uint64 buildStart = GetHiresTime();
+	if(!bench->build(&data->scene, &data->camera))
+	{
+		FreeScene(&data->scene);
+		return false;
+	}
+	data->buildSeconds = (GetHiresTime() - buildStart) / countsPerSecond;
+	data->hash = HashBenchScene(data);
+
+	gSettings.width = bench->width;
+	gSettings.height = bench->height;
+	gSettings.samplesPerPixel = bench->samplesPerPixel;
+	gSettings.maxDiffuseBounces = bench->maxDiffuseBounces;
+	gSettings.secondaryRays = bench->secondaryRays;
+	return true;
+}
+
+void FreeBenchScene(BenchSceneData * data)
+{
+	FreeScene(&data->scene);
+	*data = {};
+}
+
+// Renders every tile of the framebuffer once and returns the wall time. Pass 0 uses the
+// viewer's tile seeds, later passes offset them so every pass draws different samples.
+double RenderBenchPass(BenchSceneData * data, Framebuffer * framebuffer, int threadCount, uint32 pass)
+{
+	JobQueue jobqueue;
+	InitJobQueue(&jobqueue, framebuffer->tilesX * framebuffer->tilesY);
+	RenderKernel kernel = SelectRenderKernel(&gSettings);
+	for(int xs = 0; xs < framebuffer->tilesX; ++xs)
+	{
+		for(int ys = 0; ys < framebuffer->tilesY; ++ys)
+		{
+			RenderJob job = {};
+			SetJobTile(&job, xs, ys, framebuffer->tileSize, framebuffer->width, framebuffer->height);
+			job.seed += pass * 0x9E3779B1;
+			job.scene = &data->scene;
+			job.camera = &data->camera;
+			job.framebuffer = framebuffer;
+			job.spp = gSettings.samplesPerPixel;
+			job.kernel = kernel;
+			jobqueue.Push(job);
+		}
+	}
+	SortJobQueue(&jobqueue);
+
+	// every pass reuses the thread slots after the main thread, so the counters only
+	// hold this pass's rays
+	gThreadCounter = 1;
+	memset(rayStats, 0, sizeof(rayStats));
+	gMetrics = {};
+	gMetrics.tilesTotal = jobqueue.jobCount;
+	gMetrics.workerCount = threadCount;
+	gSettings.renderThreadCount = threadCount;
+
+	AsyncTask taskpool[MAX_RENDER_THREAD_COUNT];
+	HANDLE threadpool[MAX_RENDER_THREAD_COUNT];
+	uint64 renderStart = GetHiresTime();
+	gMetrics.renderStartTime = renderStart;
+	StartRenderThreads(taskpool, threadpool, threadCount, &jobqueue);
+	WaitForMultipleObjects(threadCount, threadpool, TRUE, INFINITE);
+	gMetrics.renderEndTime = GetHiresTime();
+	double seconds = (gMetrics.renderEndTime - renderStart) / countsPerSecond;
+	for(int i = 0; i < threadCount; ++i)
+	{
+		CloseHandle(threadpool[i]);
+	}
+	FreeJobQueue(&jobqueue);
+	return seconds;
+}
+
+// Mrays/s, or millions of camera samples/s when the build has no ray counts
+double GetBenchRate(BenchScene * bench, RayStats * rays, double seconds)
+{
+#ifdef RAY_STATS
+	uint64 totalRays = 0;
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		totalRays += rays->rays[i];
+	}
+	return totalRays / seconds / 1000000.0;
+#else
+	return (double)bench->width * bench->height * bench->samplesPerPixel / seconds / 1000000.0;
+#endif
+}
+
+// sorts values in place
+double SortAndTakeMedian(double * values, int count)
+{
+	qsort(values, count, sizeof(double), CompareDoubles);
+	return count % 2 ? values[count / 2] : 0.5 * (values[count / 2 - 1] + values[count / 2]);
+}
+
+// Distribution free interval of the median, at least 95% when there are 6 or more values:
+// the order statistics at rank r and n+1-r for the largest r with P(Binomial(n, 1/2) < r) <= 0.025.
+// With fewer values that is the full range. sorted must be in ascending order.
+void GetMedianInterval(double * sorted, int count, double * low, double * high)
+{
+	int rank = 1;
+	double term = count * pow(0.5, count); // P(X = rank)
+	double below = pow(0.5, count) + term; // P(X < rank + 1)
+	while(below <= 0.025 && rank + 1 <= count / 2)
+	{
+		rank++;
+		term = term * (count - rank + 1) / rank;
+		below += term;
+	}
+	*low = sorted[rank - 1];
+	*high = sorted[count - rank];
+}
+
+// An untimed pass goes first when repeating, so every timed one starts with warm caches.
+bool RunBenchScene(BenchScene * bench, int threadCount, int repeatCount, BenchResult * result)
+{
+	*result = {};
+	BenchSceneData data;
+	if(!BuildBenchScene(bench, &data))
+	{
+		return false;
+	}
+	result->buildSeconds = data.buildSeconds;
+	result->objectCount = data.scene.objectCount;
+	result->lightCount = data.scene.lightCount;
+	result->sceneHash = data.hash;
+	for(uint i = 0; i < data.scene.meshCount; ++i)
+	{
+		result->triangleCount += data.scene.meshes[i].triangleCount;
+	}
+
+	Framebuffer framebuffer;
+	InitFramebuffer(&framebuffer, bench->width, bench->height, FRAMEBUFFER_TILE_SIZE);
+	if(repeatCount > 1)
+	{
+		RenderBenchPass(&data, &framebuffer, threadCount, 0);
+	}
+	double seconds[MAX_BENCH_REPEATS];
+	for(int r = 0; r < repeatCount; ++r)
+	{
+		seconds[r] = RenderBenchPass(&data, &framebuffer, threadCount, 0);
+		MergeRayStats(&result->rays);
+		result->rates[r] = GetBenchRate(bench, &result->rays, seconds[r]);
+	}
+	result->repeatCount = repeatCount;
+	result->renderSeconds = SortAndTakeMedian(seconds, repeatCount);
+
+	FreeFramebuffer(&framebuffer);
+	FreeBenchScene(&data);
+	return true;
+}
+
+/* Baselines */
+
+// -save-baseline stores every scene's per-repeat rates in a text file, -baseline compares a
+// run against them. The comparison is a one sided Mann-Whitney U test on the repeats, which
+// doesn't assume the timing noise is normal (it rarely is, a few repeats always get hit by
+// the OS and run long). A scene regresses when the test says it got slower (p < BASELINE_ALPHA)
+// and its median rate dropped by more than -max-slowdown, so neither a noisy one-off nor a
+// real but negligible difference fails the run.
+//
+// A baseline is only meaningful for the same build on the same machine. The config, profile
+// level and thread count have to match; a different CPU name only gets a warning, since
+// virtual machines report the same part in different ways. Scenes match on their content
+// hash too, so a scene that changed (e.g. flat to smooth shading) isn't compared with
+// rates measured on the old one.
+
+#define BASELINE_VERSION 2
+#define BASELINE_ALPHA 0.05
+#define MAX_BASELINE_SCENES 16
+#define BASELINE_LINE_LENGTH 2048
+
+#ifdef RAY_STATS
+const char * benchRateName = "mrays";
+#else
+const char * benchRateName = "msamples";
+#endif
+
+struct BaselineScene
+{
+	char name[32];
+	int width;
+	int height;
+	int samplesPerPixel;
+	int maxDiffuseBounces;
+	int secondaryRays;
+	uint objectCount;
+	uint triangleCount;
+	uint lightCount;
+	uint32 sceneHash;
+	int repeatCount;
+	double rates[MAX_BENCH_REPEATS];
+};
+
+struct Baseline
+{
+	char cpu[64];
+	char config[16];
+	char rate[16];
+	int profileLevel;
+	int threadCount;
+	int sceneCount;
+	BaselineScene scenes[MAX_BASELINE_SCENES];
+};
+
+struct BaselineComparison
+{
+	double median; // of the baseline rates
+	double low;
+	double high;
+	double change; // relative change of the median rate, negative is slower
+	double p;
+	bool regression;
+};
+
+void GetCpuName(char * name, int length)
+{
+	int regs[12];
+	__cpuid(regs, 0x80000000);
+	if((uint)regs[0] < 0x80000004)
+	{
+		_snprintf(name, length, "unknown");
+		return;
+	}
+	__cpuid(regs + 0, 0x80000002);
+	__cpuid(regs + 4, 0x80000003);
+	__cpuid(regs + 8, 0x80000004);
+	char brand[49];
+	memcpy(brand, regs, 48);
+	brand[48] = 0;
+	const char * start = brand;
+	while(*start == ' ')
+	{
+		start++;
+	}
+	_snprintf(name, length, "%s", start);
+	name[length - 1] = 0;
+}
+
+// the header of a new baseline, for this build and machine
+void InitBaseline(Baseline * baseline, const char * config, int threadCount)
+{
+	*baseline = {};
+	GetCpuName(baseline->cpu, sizeof(baseline->cpu));
+	_snprintf(baseline->config, sizeof(baseline->config), "%s", config);
+	_snprintf(baseline->rate, sizeof(baseline->rate), "%s", benchRateName);
+	baseline->profileLevel = PROFILE_LEVEL;
+	baseline->threadCount = threadCount;
+}
+
+void AddBaselineScene(Baseline * baseline, BenchScene * bench, BenchResult * result)
+{
+	if(baseline->sceneCount == MAX_BASELINE_SCENES)
+	{
+		return;
+	}
+	BaselineScene * entry = &baseline->scenes[baseline->sceneCount++];
+	_snprintf(entry->name, sizeof(entry->name), "%s", bench->name);
+	entry->name[sizeof(entry->name) - 1] = 0;
+	entry->width = bench->width;
+	entry->height = bench->height;
+	entry->samplesPerPixel = bench->samplesPerPixel;
+	entry->maxDiffuseBounces = bench->maxDiffuseBounces;
+	entry->secondaryRays = bench->secondaryRays;
+	entry->objectCount = result->objectCount;
+	entry->triangleCount = result->triangleCount;
+	entry->lightCount = result->lightCount;
+	entry->sceneHash = result->sceneHash;
+	entry->repeatCount = result->repeatCount;
+	memcpy(entry->rates, result->rates, sizeof(entry->rates));
+}
+
+// one line per scene: name, settings, scene size and hash, repeat count and the rates
+bool WriteBaseline(Baseline * baseline, const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if(!file)
+	{
+		OutputDebugStringA("Failed to write baseline!");
+		return false;
+	}
+	fprintf(file, "rtbench baseline %d\n", BASELINE_VERSION);
+	fprintf(file, "cpu %s\n", baseline->cpu);
+	fprintf(file, "config %s\n", baseline->config);
+	fprintf(file, "profileLevel %d\n", baseline->profileLevel);
+	fprintf(file, "threads %d\n", baseline->threadCount);
+	fprintf(file, "rate %s\n", baseline->rate);
+	for(int i = 0; i < baseline->sceneCount; ++i)
+	{
+		BaselineScene * entry = &baseline->scenes[i];
+		fprintf(file, "scene %s %d %d %d %d %d %u %u %u %08x %d", entry->name, entry->width, entry->height, entry->samplesPerPixel,
+				entry->maxDiffuseBounces, entry->secondaryRays, entry->objectCount, entry->triangleCount, entry->lightCount, entry->sceneHash,
+				entry->repeatCount);
+		for(int r = 0; r < entry->repeatCount; ++r)
+		{
+			fprintf(file, " %.6f", entry->rates[r]);
+		}
+		fprintf(file, "\n");
+	}
+	fclose(file);
+	return true;
+}
+
+bool ReadBaseline(Baseline * baseline, const char * path)
+{
+	*baseline = {};
+	FILE * file = fopen(path, "r");
+	if(!file)
+	{
+		OutputDebugStringA("Failed to open baseline!");
+		return false;
+	}
+
+	char line[BASELINE_LINE_LENGTH];
+	int version = 0;
+	bool valid = fgets(line, sizeof(line), file) && sscanf(line, "rtbench baseline %d", &version) == 1 && version == BASELINE_VERSION;
+	while(valid && fgets(line, sizeof(line), file))
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		int offset = 0;
+		if(strncmp(line, "cpu ", 4) == 0)
+		{
+			_snprintf(baseline->cpu, sizeof(baseline->cpu), "%s", line + 4);
+			baseline->cpu[sizeof(baseline->cpu) - 1] = 0;
+		}
+		else if(strncmp(line, "scene ", 6) == 0 && baseline->sceneCount < MAX_BASELINE_SCENES)
+		{
+			BaselineScene * entry = &baseline->scenes[baseline->sceneCount];
+			valid = sscanf(line, "scene %31s %d %d %d %d %d %u %u %u %x %d%n", entry->name, &entry->width, &entry->height, &entry->samplesPerPixel,
+						   &entry->maxDiffuseBounces, &entry->secondaryRays, &entry->objectCount, &entry->triangleCount, &entry->lightCount,
+						   &entry->sceneHash, &entry->repeatCount, &offset) == 11 && entry->repeatCount >= 1 && entry->repeatCount <= MAX_BENCH_REPEATS;
+			char * cursor = line + offset;
+			for(int r = 0; valid && r < entry->repeatCount; ++r)
+			{
+				char * end = nullptr;
+				entry->rates[r] = strtod(cursor, &end);
+				valid = end != cursor;
+				cursor = end;
+			}
+			baseline->sceneCount++;
+		}
+		else
+		{
+			// each only matches its own key
+			sscanf(line, "config %15s", baseline->config);
+			sscanf(line, "profileLevel %d", &baseline->profileLevel);
+			sscanf(line, "threads %d", &baseline->threadCount);
+			sscanf(line, "rate %15s", baseline->rate);
+		}
+	}
+	fclose(file);
+	if(!valid)
+	{
+		OutputDebugStringA("Invalid baseline!");
+		return false;
+	}
+	return true;
+}
+
+// the same scene, settings, scene size and content, nullptr when the baseline doesn't have it
+BaselineScene * FindBaselineScene(Baseline * baseline, BenchScene * bench, BenchResult * result)
+{
+	for(int i = 0; i < baseline->sceneCount; ++i)
+	{
+		BaselineScene * entry = &baseline->scenes[i];
+		if(strcmp(entry->name, bench->name) == 0 &&
+		   entry->width == bench->width && entry->height == bench->height &&
+		   entry->samplesPerPixel == bench->samplesPerPixel &&
+		   entry->maxDiffuseBounces == bench->maxDiffuseBounces &&
+		   entry->secondaryRays == bench->secondaryRays &&
+		   entry->objectCount == result->objectCount &&
+		   entry->triangleCount == result->triangleCount &&
+		   entry->lightCount == result->lightCount &&
+		   entry->sceneHash == result->sceneHash)
+		{
+			return entry;
+		}
+	}
+	return nullptr;
+}
+
+// One sided p value of the current rates being lower than the baseline ones, from the normal
+// approximation of U with tie and continuity corrections. Good enough from about 5 repeats
+// each; with fewer it can't go below BASELINE_ALPHA, so nothing fails on too little data.
+double MannWhitneySlowerP(double * baseline, int baselineCount, double * current, int currentCount)
+{
+	// pairs where the current repeat was slower, ties count half
+	double u = 0.0;
+	for(int i = 0; i < baselineCount; ++i)
+	{
+		for(int j = 0; j < currentCount; ++j)
+		{
+			u += current[j] < baseline[i] ? 1.0 : (current[j] == baseline[i] ? 0.5 : 0.0);
+		}
+	}
+
+	double pooled[2 * MAX_BENCH_REPEATS];
+	int n = baselineCount + currentCount;
+	memcpy(pooled, baseline, baselineCount * sizeof(double));
+	memcpy(pooled + baselineCount, current, currentCount * sizeof(double));
+	qsort(pooled, n, sizeof(double), CompareDoubles);
+	double ties = 0.0;
+	for(int i = 0; i < n;)
+	{
+		int j = i;
+		while(j < n && pooled[j] == pooled[i])
+		{
+			j++;
+		}
+		double t = j - i;
+		ties += t * t * t - t;
+		i = j;
+	}
+
+	double mean = baselineCount * currentCount / 2.0;
+	double variance = baselineCount * currentCount / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+	if(variance <= 0.0)
+	{
+		return 1.0;
+	}
+	double z = (u - mean - 0.5) / sqrt(variance);
+	return 0.5 * erfc(z / sqrt(2.0));
+}
+
+void CompareWithBaseline(BaselineScene * entry, BenchResult * result, int maxSlowdown, BaselineComparison * comparison)
+{
+	double baselineRates[MAX_BENCH_REPEATS];
+	double currentRates[MAX_BENCH_REPEATS];
+	memcpy(baselineRates, entry->rates, sizeof(baselineRates));
+	memcpy(currentRates, result->rates, sizeof(currentRates));
+	comparison->median = SortAndTakeMedian(baselineRates, entry->repeatCount);
+	GetMedianInterval(baselineRates, entry->repeatCount, &comparison->low, &comparison->high);
+	double median = SortAndTakeMedian(currentRates, result->repeatCount);
+	comparison->change = median / comparison->median - 1.0;
+	comparison->p = MannWhitneySlowerP(entry->rates, entry->repeatCount, result->rates, result->repeatCount);
+	comparison->regression = comparison->p < BASELINE_ALPHA && -comparison->change * 100.0 > maxSlowdown;
+}
+
+void WriteBenchResult(FILE * file, BenchScene * bench, BenchResult * result, BaselineComparison * comparison, bool first)
+{
+	uint64 totalRays = 0;
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		totalRays += result->rays.rays[i];
+	}
+	double samples = (double)bench->width * bench->height * bench->samplesPerPixel;
+	double seconds = result->renderSeconds;
+
+	fprintf(file, "%s    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"spp\": %d, \"bounces\": %d, \"secondaryRays\": %d,\n",
+			first ? "" : ",\n", bench->name, bench->width, bench->height, bench->samplesPerPixel, bench->maxDiffuseBounces, bench->secondaryRays);
+	fprintf(file, "     \"objects\": %u, \"triangles\": %u, \"lights\": %u, \"buildSeconds\": %.4f,\n",
+			result->objectCount, result->triangleCount, result->lightCount, result->buildSeconds);
+	fprintf(file, "     \"wallSeconds\": %.4f, \"rays\": %llu, \"mraysPerSecond\": %.3f, \"samplesPerSecond\": %.1f,\n",
+			seconds, totalRays, seconds > 0.0 ? totalRays / seconds / 1000000.0 : 0.0, seconds > 0.0 ? samples / seconds : 0.0);
+	fprintf(file, "     \"raysByType\": {");
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		fprintf(file, "%s\"%s\": %llu", i ? ", " : "", rayTypeNames[i], result->rays.rays[i]);
+	}
+	fprintf(file, "},\n");
+
+	double rates[MAX_BENCH_REPEATS];
+	memcpy(rates, result->rates, sizeof(rates));
+	double median = SortAndTakeMedian(rates, result->repeatCount);
+	double low, high;
+	GetMedianInterval(rates, result->repeatCount, &low, &high);
+	fprintf(file, "     \"repeats\": %d, \"rate\": \"%s\", \"rateMedian\": %.3f, \"rateInterval\": [%.3f, %.3f]",
+			result->repeatCount, benchRateName, median, low, high);
+	if(comparison)
+	{
+		fprintf(file, ",\n     \"baseline\": {\"rateMedian\": %.3f, \"rateInterval\": [%.3f, %.3f], \"change\": %.4f, \"p\": %.4g, \"regression\": %s}",
+				comparison->median, comparison->low, comparison->high, comparison->change, comparison->p, comparison->regression ? "true" : "false");
+	}
+	fprintf(file, "}");
+}
+
+/* Convergence */
+
+// Error against a high spp reference at fixed wall clock budgets. A pass is one sample per
+// pixel (as set up by the scene) over the whole image, passes are averaged progressively.
+// The reference is the average of many passes with seeds no progressive pass uses, and is
+// cached as a .pfm next to the executable since it is by far the slowest part. The cache name
+// has the scene hash and REFERENCE_VERSION in it, bump that when the renderer's output changes.
+//
+// The reference has noise of its own, once the progressive average gets within a few times
+// its pass count the error measures that noise more than convergence. So the curve stops at
+// 1/REFERENCE_PASS_RATIO of the reference passes.
+
+#define MAX_CONVERGENCE_POINTS 4096
+#define REFERENCE_PASS_OFFSET (1<<24)
+#define REFERENCE_PASS_RATIO 10
+#define REFERENCE_VERSION 1
+
+double convergenceCheckpoints[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+struct ConvergencePoint
+{
+	double seconds; // render time only, computing the error isn't counted
+	int passes;
+	double rmse;
+	double relMSE;
+};
+
+// every pixel of the tile-major layout, padding included, the layouts match
+void AccumulateFramebuffer(Framebuffer * sum, Framebuffer * pass)
+{
+	size_t count = (size_t)sum->tilesX * sum->tilesY * sum->tileSize * sum->tileSize;
+	for(size_t i = 0; i < count; ++i)
+	{
+		sum->pixels[i] += pass->pixels[i];
+	}
+}
+
+// relMSE divides by the squared reference plus a small constant, so dark pixels don't dominate
+void ComputeImageError(Framebuffer * sum, float scale, Framebuffer * reference, double * rmse, double * relMSE)
+{
+	double squaredError = 0.0;
+	double relativeError = 0.0;
+	for(int y = 0; y < reference->height; ++y)
+	{
+		for(int x = 0; x < reference->width; ++x)
+		{
+			V4 value = GetPixel(sum, x, y) * scale;
+			V4 ref = GetPixel(reference, x, y);
+			for(int c = 0; c < 3; ++c)
+			{
+				double d = value.v[c] - ref.v[c];
+				squaredError += d * d;
+				relativeError += d * d / (ref.v[c] * ref.v[c] + 0.01);
+			}
+		}
+	}
+	double count = 3.0 * reference->width * reference->height;
+	*rmse = sqrt(squaredError / count);
+	*relMSE = relativeError / count;
+}
+
+bool RunConvergence(FILE * file, BenchScene * bench, int threadCount, const char * referencePath, int referencePasses, int budget)
+{
+	BenchSceneData data;
+	if(!BuildBenchScene(bench, &data))
+	{
+		return false;
+	}
+
+	char defaultPath[MAX_PATH];
+	if(!referencePath)
+	{
+		_snprintf(defaultPath, MAX_PATH, "bench_%s_%dx%d_%dspp_%db_%dsr_%dp_%08x_v%d.pfm", bench->name, bench->width, bench->height,
+				  bench->samplesPerPixel, bench->maxDiffuseBounces, bench->secondaryRays, referencePasses, data.hash, REFERENCE_VERSION);
+		defaultPath[MAX_PATH - 1] = 0;
+		referencePath = defaultPath;
+	}
+
+	Framebuffer pass, sum, reference;
+	InitFramebuffer(&pass, bench->width, bench->height, FRAMEBUFFER_TILE_SIZE);
+	InitFramebuffer(&sum, bench->width, bench->height, FRAMEBUFFER_TILE_SIZE);
+	InitFramebuffer(&reference, bench->width, bench->height, FRAMEBUFFER_TILE_SIZE);
+
+	bool referenceCached = ReadPFM(referencePath, &reference);
+	if(!referenceCached)
+	{
+		fprintf(stderr, "Rendering %d pass reference %s\n", referencePasses, referencePath);
+		for(int p = 0; p < referencePasses; ++p)
+		{
+			RenderBenchPass(&data, &pass, threadCount, REFERENCE_PASS_OFFSET + p);
+			AccumulateFramebuffer(&reference, &pass);
+		}
+		size_t count = (size_t)reference.tilesX * reference.tilesY * reference.tileSize * reference.tileSize;
+		for(size_t i = 0; i < count; ++i)
+		{
+			reference.pixels[i] = reference.pixels[i] / (float)referencePasses;
+		}
+		// a partly written reference would be read back as a good one next time
+		if(!WriteImage(&reference, referencePath))
+		{
+			fprintf(stderr, "Warning: failed to write reference %s, it won't be cached\n", referencePath);
+			DeleteFileA(referencePath);
+		}
+	}
+
+	ConvergencePoint * curve = TRACKED_NEW(MEMORY_SCRATCH, ConvergencePoint, MAX_CONVERGENCE_POINTS);
+	int pointCount = 0;
+	int maxPasses = min(max(referencePasses / REFERENCE_PASS_RATIO, 1), MAX_CONVERGENCE_POINTS);
+	double elapsed = 0.0;
+	while(elapsed < budget && pointCount < maxPasses)
+	{
+		uint64 start = GetHiresTime();
+		RenderBenchPass(&data, &pass, threadCount, pointCount);
+		AccumulateFramebuffer(&sum, &pass);
+		elapsed += (GetHiresTime() - start) / countsPerSecond;
+
+		ConvergencePoint * point = &curve[pointCount++];
+		point->seconds = elapsed;
+		point->passes = pointCount;
+		ComputeImageError(&sum, 1.0f / pointCount, &reference, &point->rmse, &point->relMSE);
+		fprintf(stderr, "%8.3fs %6d passes  RMSE %.6f  relMSE %.6f\n", point->seconds, point->passes, point->rmse, point->relMSE);
+	}
+	bool limitedByReference = elapsed < budget && pointCount == maxPasses;
+	if(limitedByReference)
+	{
+		fprintf(stderr, "Warning: stopped at %d passes after %.1fs, raise -reference-passes to %d or more to fill the budget\n",
+				pointCount, elapsed, (int)(REFERENCE_PASS_RATIO * pointCount * budget / elapsed) + 1);
+	}
+
+	fprintf(file, "\"threads\": %d, \"convergence\": {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"spp\": %d, \"bounces\": %d, \"secondaryRays\": %d,\n",
+			threadCount, bench->name, bench->width, bench->height, bench->samplesPerPixel, bench->maxDiffuseBounces, bench->secondaryRays);
+	fprintf(file, "  \"reference\": \"%s\", \"referencePasses\": %d, \"referenceCached\": %s, \"sceneHash\": \"%08x\", \"budgetSeconds\": %d,\n",
+			referencePath, referencePasses, referenceCached ? "true" : "false", data.hash, budget);
+	fprintf(file, "  \"limitedByReference\": %s,\n", limitedByReference ? "true" : "false");
+
+	// the last pass that finished within each budget, none past where the reference stopped the curve
+	fprintf(file, "  \"checkpoints\": [");
+	bool first = true;
+	for(int c = 0; c < sizeof(convergenceCheckpoints)/sizeof(convergenceCheckpoints[0]) && convergenceCheckpoints[c] <= budget; ++c)
+	{
+		if(limitedByReference && convergenceCheckpoints[c] > elapsed)
+		{
+			break;
+		}
+		ConvergencePoint * point = nullptr;
+		for(int i = 0; i < pointCount && curve[i].seconds <= convergenceCheckpoints[c]; ++i)
+		{
+			point = &curve[i];
+		}
+		if(point)
+		{
+			fprintf(file, "%s\n    {\"budgetSeconds\": %g, \"seconds\": %.4f, \"passes\": %d, \"rmse\": %.8f, \"relMSE\": %.8f}",
+					first ? "" : ",", convergenceCheckpoints[c], point->seconds, point->passes, point->rmse, point->relMSE);
+			first = false;
+		}
+	}
+	fprintf(file, "],\n  \"curve\": [");
+	for(int i = 0; i < pointCount; ++i)
+	{
+		fprintf(file, "%s\n    {\"seconds\": %.4f, \"passes\": %d, \"rmse\": %.8f, \"relMSE\": %.8f}",
+				i ? "," : "", curve[i].seconds, curve[i].passes, curve[i].rmse, curve[i].relMSE);
+	}
+	fprintf(file, "]}");
+
+	TRACKED_DELETE(MEMORY_SCRATCH, curve, MAX_CONVERGENCE_POINTS);
+	FreeFramebuffer(&pass);
+	FreeFramebuffer(&sum);
+	FreeFramebuffer(&reference);
+	FreeBenchScene(&data);
+	return true;
+}
+
+/* Thread scaling */
+
+// Renders one scene with 1, 2, 4, ... workers up to all cores, once with the profiler on and
+// once with it off, and splits every worker's wall time into
+//   busy     rendering tiles
+//   startup  before its first tile: thread creation and start
+//   gaps     between tiles: taking the next job off the queue
+//   tail     after its last tile, waiting for the slowest worker: tile size and imbalance
+// Busy time that grows with the worker count (busyInflation, total busy over total busy with
+// one worker) is contention in the tile work itself: memory bandwidth, shared cache lines in
+// the framebuffer or the profiler tables. Comparing the profiled and unprofiled runs separates
+// the latter.
+
+// renders at this multiple of the bench resolution, so there are enough tiles to go around
+#define SCALING_RESOLUTION_FACTOR 4
+#define MAX_SCALING_RUNS 16
+
+struct WorkerScaling
+{
+	LONG tiles;
+	double busy;
+	double startup;
+	double gaps;
+	double tail;
+};
+
+struct ScalingRun
+{
+	int threadCount;
+	bool profiled;
+	double seconds;
+	double busyTotal;
+	WorkerScaling workers[MAX_RENDER_THREAD_COUNT];
+};
+
+void CollectScalingRun(ScalingRun * run)
+{
+	run->seconds = (gMetrics.renderEndTime - gMetrics.renderStartTime) / countsPerSecond;
+	run->busyTotal = 0.0;
+	for(int i = 0; i < run->threadCount; ++i)
+	{
+		WorkerScaling * worker = &run->workers[i];
+		*worker = {};
+		worker->tiles = gMetrics.workerTiles[i];
+		worker->busy = gMetrics.workerBusyTime[i] / countsPerSecond;
+		if(worker->tiles)
+		{
+			worker->startup = (gMetrics.workerFirstTileTime[i] - gMetrics.renderStartTime) / countsPerSecond;
+			worker->gaps = (gMetrics.workerLastTileTime[i] - gMetrics.workerFirstTileTime[i]) / countsPerSecond - worker->busy;
+			worker->tail = (gMetrics.renderEndTime - gMetrics.workerLastTileTime[i]) / countsPerSecond;
+		}
+		else
+		{
+			worker->startup = run->seconds;
+		}
+		run->busyTotal += worker->busy;
+	}
+}
+
+void WriteScalingRun(FILE * file, ScalingRun * run, ScalingRun * baseline, bool first)
+{
+	double speedup = run->seconds > 0.0 ? baseline->seconds / run->seconds : 0.0;
+	double busyMax = 0.0, startup = 0.0, gaps = 0.0, tail = 0.0;
+	for(int i = 0; i < run->threadCount; ++i)
+	{
+		busyMax = max(busyMax, run->workers[i].busy);
+		startup += run->workers[i].startup;
+		gaps += run->workers[i].gaps;
+		tail += run->workers[i].tail;
+	}
+	double busyMean = run->busyTotal / run->threadCount;
+	double workerSeconds = run->seconds * run->threadCount;
+
+	fprintf(file, "%s\n    {\"threads\": %d, \"profiled\": %s, \"wallSeconds\": %.4f, \"speedup\": %.3f, \"efficiency\": %.4f,\n",
+			first ? "" : ",", run->threadCount, run->profiled ? "true" : "false", run->seconds, speedup, speedup / run->threadCount);
+	fprintf(file, "     \"busyFraction\": %.4f, \"startupFraction\": %.4f, \"gapFraction\": %.4f, \"tailFraction\": %.4f,\n",
+			run->busyTotal / workerSeconds, startup / workerSeconds, gaps / workerSeconds, tail / workerSeconds);
+	fprintf(file, "     \"busyInflation\": %.4f, \"imbalance\": %.4f, \"workers\": [",
+			baseline->busyTotal > 0.0 ? run->busyTotal / baseline->busyTotal : 0.0, busyMean > 0.0 ? busyMax / busyMean : 0.0);
+	for(int i = 0; i < run->threadCount; ++i)
+	{
+		WorkerScaling * worker = &run->workers[i];
+		fprintf(file, "%s\n       {\"tiles\": %ld, \"busy\": %.4f, \"startup\": %.4f, \"gaps\": %.4f, \"tail\": %.4f}",
+				i ? "," : "", worker->tiles, worker->busy, worker->startup, worker->gaps, worker->tail);
+	}
+	fprintf(file, "]}");
+
+	fprintf(stderr, "%3d threads %-10s %8.3fs  %6.2fx  %5.1f%%  idle: startup %4.1f%% gaps %4.1f%% tail %4.1f%%  busy x%.2f\n",
+			run->threadCount, run->profiled ? "profiled" : "unprofiled", run->seconds, speedup, 100.0 * speedup / run->threadCount,
+			100.0 * startup / workerSeconds, 100.0 * gaps / workerSeconds, 100.0 * tail / workerSeconds,
+			baseline->busyTotal > 0.0 ? run->busyTotal / baseline->busyTotal : 0.0);
+}
+
+bool RunScaling(FILE * file, BenchScene * bench, int maxThreadCount)
+{
+	BenchSceneData data;
+	if(!BuildBenchScene(bench, &data))
+	{
+		return false;
+	}
+	Framebuffer framebuffer;
+	InitFramebuffer(&framebuffer, bench->width * SCALING_RESOLUTION_FACTOR, bench->height * SCALING_RESOLUTION_FACTOR, FRAMEBUFFER_TILE_SIZE);
+
+	int threadCounts[MAX_SCALING_RUNS];
+	int runCount = 0;
+	for(int n = 1; n < maxThreadCount; n *= 2)
+	{
+		threadCounts[runCount++] = n;
+	}
+	threadCounts[runCount++] = maxThreadCount;
+
+	fprintf(file, "\"threads\": %d, \"scaling\": {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"tiles\": %d, \"runs\": [",
+			maxThreadCount, bench->name, framebuffer.width, framebuffer.height, framebuffer.tilesX * framebuffer.tilesY);
+
+	// the single thread runs are the baselines, one profiled and one not
+	ScalingRun run;
+	ScalingRun baselines[2];
+	bool first = true;
+	for(int r = 0; r < runCount; ++r)
+	{
+		for(int profiled = 1; profiled >= 0; --profiled)
+		{
+			ScalingRun * baseline = &baselines[profiled ? 0 : 1];
+			run.threadCount = threadCounts[r];
+			run.profiled = profiled != 0;
+			gProfileEnabled = run.profiled;
+			RenderBenchPass(&data, &framebuffer, run.threadCount, 0);
+			CollectScalingRun(&run);
+			if(r == 0)
+			{
+				*baseline = run;
+			}
+			WriteScalingRun(file, &run, baseline, first);
+			first = false;
+		}
+	}
+	fprintf(file, "]}");
+	gProfileEnabled = true;
+
+	FreeFramebuffer(&framebuffer);
+	FreeBenchScene(&data);
+	return true;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * jsonPath = nullptr;
+	const char * sceneName = nullptr;
+	const char * kernelName = nullptr;
+	bool micro = false;
+	bool samplers = false;
+	const char * samplerName = nullptr;
+	bool converge = false;
+	const char * referencePath = nullptr;
+	int referencePasses = 256;
+	int budget = 30;
+	bool scaling = false;
+	int maxThreadCount = min((int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS), MAX_RENDER_THREAD_COUNT);
+	int repeatCount = 0;
+	const char * baselinePath = nullptr;
+	const char * saveBaselinePath = nullptr;
+	int maxSlowdown = 5;
+	bool argsValid = ParseSettings(argc, argv, &gSettings);
+	for(int i = 1; i < argc && argsValid; ++i)
+	{
+		if(strcmp(argv[i], "-json") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &jsonPath);
+		else if(strcmp(argv[i], "-scene") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &sceneName);
+		else if(strcmp(argv[i], "-kernel") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &kernelName);
+		else if(strcmp(argv[i], "-micro") == 0)
+			micro = true;
+		else if(strcmp(argv[i], "-samplers") == 0)
+			samplers = true;
+		else if(strcmp(argv[i], "-sampler") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &samplerName);
+		else if(strcmp(argv[i], "-converge") == 0)
+			converge = true;
+		else if(strcmp(argv[i], "-reference") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &referencePath);
+		else if(strcmp(argv[i], "-reference-passes") == 0)
+			argsValid = ParseIntArgument(argc, argv, &i, &referencePasses);
+		else if(strcmp(argv[i], "-budget") == 0)
+			argsValid = ParseIntArgument(argc, argv, &i, &budget);
+		else if(strcmp(argv[i], "-scaling") == 0)
+			scaling = true;
+		else if(strcmp(argv[i], "-max-threads") == 0)
+			argsValid = ParseIntArgument(argc, argv, &i, &maxThreadCount);
+		else if(strcmp(argv[i], "-repeats") == 0)
+			argsValid = ParseIntArgument(argc, argv, &i, &repeatCount);
+		else if(strcmp(argv[i], "-baseline") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &baselinePath);
+		else if(strcmp(argv[i], "-save-baseline") == 0)
+			argsValid = ParseStringArgument(argc, argv, &i, &saveBaselinePath);
+		else if(strcmp(argv[i], "-max-slowdown") == 0)
+			argsValid = ParseIntArgument(argc, argv, &i, &maxSlowdown);
+	}
+	// a single render says nothing about the noise, baselines take 10 unless told otherwise
+	if(repeatCount == 0)
+	{
+		repeatCount = baselinePath || saveBaselinePath ? 10 : 1;
+	}
+	if(referencePasses < 1 || budget < 1 || maxThreadCount < 1 || maxThreadCount > MAX_RENDER_THREAD_COUNT ||
+	   repeatCount < 1 || repeatCount > MAX_BENCH_REPEATS || maxSlowdown < 0)
+	{
+		argsValid = false;
+	}
+	if(!argsValid)
+	{
+		fprintf(stderr, "Invalid command line!\n");
+		return 1;
+	}
+	int threadCount = gSettings.renderThreadCount;
+
+	InitProfiler();
+	InitTrace();
+	gProfileEnabled = !gSettings.profileDisabled;
+	gThreadIdMap[GetCurrentThreadId()] = gThreadCounter++;
+	SetTraceThreadName(LOCAL_THREAD_ID, "Main");
+
+	FILE * file = jsonPath ? fopen(jsonPath, "w") : stdout;
+	if(!file)
+	{
+		fprintf(stderr, "Failed to open %s!\n", jsonPath);
+		return 1;
+	}
+
+#ifdef _DEBUG_
+	const char * config = "debug";
+#else
+	const char * config = "release";
+#endif
+	fprintf(file, "{\"config\": \"%s\", \"profileLevel\": %d, ", config, PROFILE_LEVEL);
+	if(micro || samplers)
+	{
+		if(micro)
+			RunMicroBenchmarks(file, kernelName);
+		else
+			RunSampleStats(file, samplerName);
+		fprintf(file, "}\n");
+		if(file != stdout)
+		{
+			fclose(file);
+		}
+		return 0;
+	}
+	if(converge || scaling)
+	{
+		// one scene, cornell unless -scene says otherwise
+		BenchScene * bench = nullptr;
+		for(int i = 0; i < sizeof(benchScenes)/sizeof(benchScenes[0]); ++i)
+		{
+			if(strcmp(sceneName ? sceneName : "cornell", benchScenes[i].name) == 0)
+			{
+				bench = &benchScenes[i];
+			}
+		}
+		bool ran = false;
+		if(bench)
+		{
+			ran = converge ? RunConvergence(file, bench, threadCount, referencePath, referencePasses, budget)
+						   : RunScaling(file, bench, maxThreadCount);
+		}
+		fprintf(file, "}\n");
+		if(file != stdout)
+		{
+			fclose(file);
+		}
+		if(!ran)
+		{
+			fprintf(stderr, "Failed to run scene %s!\n", sceneName ? sceneName : "cornell");
+			return 1;
+		}
+		return 0;
+	}
+
+	Baseline baseline;
+	if(baselinePath)
+	{
+		if(!ReadBaseline(&baseline, baselinePath))
+		{
+			fprintf(stderr, "Failed to read baseline %s!\n", baselinePath);
+			return 1;
+		}
+		char cpu[sizeof(baseline.cpu)];
+		GetCpuName(cpu, sizeof(cpu));
+		if(strcmp(baseline.config, config) != 0 || baseline.profileLevel != PROFILE_LEVEL ||
+		   baseline.threadCount != threadCount || strcmp(baseline.rate, benchRateName) != 0)
+		{
+			fprintf(stderr, "Baseline is from a %s build with profile level %d on %d threads, this is a %s build with profile level %d on %d threads!\n",
+					baseline.config, baseline.profileLevel, baseline.threadCount, config, PROFILE_LEVEL, threadCount);
+			return 1;
+		}
+		if(strcmp(baseline.cpu, cpu) != 0)
+		{
+			fprintf(stderr, "Warning: baseline is from %s, this is %s\n", baseline.cpu, cpu);
+		}
+	}
+	Baseline newBaseline;
+	InitBaseline(&newBaseline, config, threadCount);
+
+	fprintf(file, "\"threads\": %d, \"cpu\": \"%s\", \"scenes\": [\n", threadCount, newBaseline.cpu);
+	bool first = true;
+	int result = 0;
+	int regressionCount = 0;
+	for(int i = 0; i < sizeof(benchScenes)/sizeof(benchScenes[0]); ++i)
+	{
+		BenchScene * bench = &benchScenes[i];
+		if(sceneName ? strcmp(sceneName, bench->name) != 0 : bench->build == BuildGeneratedScene)
+		{
+			continue;
+		}
+
+		BenchResult benchResult;
+		if(!RunBenchScene(bench, threadCount, repeatCount, &benchResult))
+		{
+			fprintf(stderr, "Failed to build scene %s!\n", bench->name);
+			result = 1;
+			continue;
+		}
+		AddBaselineScene(&newBaseline, bench, &benchResult);
+
+		BaselineComparison comparison;
+		BaselineScene * entry = baselinePath ? FindBaselineScene(&baseline, bench, &benchResult) : nullptr;
+		if(entry)
+		{
+			CompareWithBaseline(entry, &benchResult, maxSlowdown, &comparison);
+			fprintf(stderr, "%-12s %8.3fs %+6.1f%% p=%.3g%s\n", bench->name, benchResult.renderSeconds,
+					comparison.change * 100.0, comparison.p, comparison.regression ? " REGRESSION" : "");
+			regressionCount += comparison.regression ? 1 : 0;
+		}
+		else
+		{
+			if(baselinePath)
+			{
+				fprintf(stderr, "Warning: scene %s isn't in the baseline\n", bench->name);
+			}
+			fprintf(stderr, "%-12s %8.3fs\n", bench->name, benchResult.renderSeconds);
+		}
+		WriteBenchResult(file, bench, &benchResult, entry ? &comparison : nullptr, first);
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+
+	if(file != stdout)
+	{
+		fclose(file);
+	}
+	if(saveBaselinePath && !WriteBaseline(&newBaseline, saveBaselinePath))
+	{
+		fprintf(stderr, "Failed to write baseline %s!\n", saveBaselinePath);
+		result = 1;
+	}
+	if(regressionCount)
+	{
+		fprintf(stderr, "%d scene(s) slower than the baseline by more than %d%%\n", regressionCount, maxSlowdown);
+		return 2;
+	}
+	return result;
+}
@@ -8,3 +8,16 @@ struct Camera
 	float filmWidth;
 	float focalLength;
 };
+
+// Left-handed, +X is front, +Y is right, +Z is up
+Camera LookAt(V3 position, V3 target, float filmWidth, float focalLength)
+{
+	Camera cam;
+	cam.position = position;
+	cam.direction = Normalize(target - position);
+	V3 up = {0, 0, 1};
+	cam.up = Normalize(up - cam.direction * Dot(up, cam.direction));
+	cam.filmWidth = filmWidth;
+	cam.focalLength = focalLength;
+	return cam;
+}
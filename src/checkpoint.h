@@ -0,0 +1,328 @@
+#pragma once
+
+// Crash-safe render checkpoints. The checkpoint is a journal: a header with the
+// render configuration, created atomically (temp file + rename), followed by one
+// record per finished tile. A background thread appends records for newly finished
+// tiles and flushes the file every interval. Records carry a checksum, so a record
+// torn by a crash is detected on resume and the journal is cut back to the last
+// good one.
+//
+// Tiles are the unit of progress: every pixel of a finished tile has all of its
+// samples, and each tile's RNG is seeded from its job seed, so a tile that was in
+// flight when the process died renders to the same result after resuming.
+
+#define CHECKPOINT_MAGIC 0x4b435452 // 'RTCK'
+#define CHECKPOINT_VERSION 4
+
+enum TileState
+{
+	TILE_PENDING,
+	TILE_DONE,
+	TILE_SAVED,
+};
+
+struct CheckpointHeader
+{
+	uint32 magic;
+	uint32 version;
+	int32 width;
+	int32 height;
+	int32 tileSize;
+	int32 samplesPerPixel;
+	int32 maxDiffuseBounces;
+	int32 secondaryRays;
+	SceneGenParams sceneGen; // all zero counts for the InitScene scene
+};
+
+struct CheckpointTileRecord
+{
+	uint32 tileIndex;
+	uint32 sampleCount; // samples accumulated in every pixel of the tile
+	uint32 seed; // RNG seed the tile was rendered with
+	uint32 checksum; // of the fields above and the pixel data that follows, must stay last
+};
+
+struct Checkpoint
+{
+	HANDLE file;
+	Framebuffer * framebuffer;
+	volatile LONG * tileStates;
+	uint32 * tileSeeds;
+	int tileCount;
+	int samplesPerPixel;
+	uint64 writeOffset;
+	DWORD intervalMs;
+	HANDLE thread;
+	HANDLE stopEvent;
+};
+
+// FNV-1a, pass the previous hash to continue it over another block
+uint32 Checksum(const void * data, size_t size, uint32 hash = 2166136261u)
+{
+	const uint8 * bytes = (const uint8 *)data;
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// a bad tile index or seed is caught as well as torn pixels
+uint32 ChecksumTileRecord(CheckpointTileRecord * record, const V4 * tile, size_t tileBytes)
+{
+	uint32 hash = Checksum(record, offsetof(CheckpointTileRecord, checksum));
+	return Checksum(tile, tileBytes, hash);
+}
+
+CheckpointHeader MakeCheckpointHeader(RenderSettings * settings, int tileSize)
+{
+	CheckpointHeader header = {};
+	header.magic = CHECKPOINT_MAGIC;
+	header.version = CHECKPOINT_VERSION;
+	header.width = settings->width;
+	header.height = settings->height;
+	header.tileSize = tileSize;
+	header.samplesPerPixel = settings->samplesPerPixel;
+	header.maxDiffuseBounces = settings->maxDiffuseBounces;
+	header.secondaryRays = settings->secondaryRays;
+	header.sceneGen = settings->sceneGen;
+	return header;
+}
+
+// Applies the render configuration stored in a checkpoint, so a resumed render
+// uses exactly the settings it was started with.
+bool ReadCheckpointSettings(const char * path, RenderSettings * settings)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		OutputDebugStringA("Failed to open checkpoint!");
+		return false;
+	}
+
+	CheckpointHeader header = {};
+	bool ok = ReadAt(file, 0, &header, sizeof(header));
+	CloseHandle(file);
+	if(!ok || header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION || header.tileSize != FRAMEBUFFER_TILE_SIZE)
+	{
+		OutputDebugStringA("Checkpoint header is invalid!");
+		return false;
+	}
+
+	settings->width = header.width;
+	settings->height = header.height;
+	settings->samplesPerPixel = header.samplesPerPixel;
+	settings->maxDiffuseBounces = header.maxDiffuseBounces;
+	settings->secondaryRays = header.secondaryRays;
+	settings->sceneGen = header.sceneGen;
+	return true;
+}
+
+void InitCheckpointState(Checkpoint * checkpoint, Framebuffer * fb, RenderSettings * settings)
+{
+	*checkpoint = {};
+	checkpoint->framebuffer = fb;
+	checkpoint->tileCount = fb->tilesX * fb->tilesY;
+	checkpoint->samplesPerPixel = settings->samplesPerPixel;
+	checkpoint->intervalMs = settings->checkpointInterval * 1000;
+	checkpoint->tileStates = TRACKED_NEW(MEMORY_OTHER, LONG, checkpoint->tileCount);
+	checkpoint->tileSeeds = TRACKED_NEW(MEMORY_OTHER, uint32, checkpoint->tileCount);
+	for(int i = 0; i < checkpoint->tileCount; ++i)
+	{
+		checkpoint->tileStates[i] = TILE_PENDING;
+		checkpoint->tileSeeds[i] = 0;
+	}
+}
+
+bool CreateCheckpoint(Checkpoint * checkpoint, const char * path, Framebuffer * fb, RenderSettings * settings)
+{
+	InitCheckpointState(checkpoint, fb, settings);
+
+	char tempPath[MAX_PATH];
+	_snprintf(tempPath, MAX_PATH, "%s.tmp", path);
+	HANDLE temp = CreateFileA(tempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(temp == INVALID_HANDLE_VALUE)
+	{
+		OutputDebugStringA("Failed to create checkpoint!");
+		return false;
+	}
+
+	CheckpointHeader header = MakeCheckpointHeader(settings, fb->tileSize);
+	bool ok = WriteAt(temp, 0, &header, sizeof(header));
+	ok = ok && FlushFileBuffers(temp);
+	CloseHandle(temp);
+	ok = ok && MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	if(ok)
+	{
+		checkpoint->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		ok = checkpoint->file != INVALID_HANDLE_VALUE;
+	}
+	if(!ok)
+	{
+		OutputDebugStringA("Failed to create checkpoint!");
+		checkpoint->file = NULL;
+		return false;
+	}
+
+	checkpoint->writeOffset = sizeof(header);
+	return true;
+}
+
+// Loads every intact tile record into the framebuffer and marks those tiles as saved.
+// Returns the number of tiles restored, or -1 on failure.
+int LoadCheckpoint(Checkpoint * checkpoint, const char * path, Framebuffer * fb, RenderSettings * settings)
+{
+	TRACE_SCOPE("LoadCheckpoint");
+	InitCheckpointState(checkpoint, fb, settings);
+
+	checkpoint->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(checkpoint->file == INVALID_HANDLE_VALUE)
+	{
+		OutputDebugStringA("Failed to open checkpoint!");
+		checkpoint->file = NULL;
+		return -1;
+	}
+
+	CheckpointHeader expected = MakeCheckpointHeader(settings, fb->tileSize);
+	CheckpointHeader header = {};
+	if(!ReadAt(checkpoint->file, 0, &header, sizeof(header)) || memcmp(&header, &expected, sizeof(header)) != 0)
+	{
+		OutputDebugStringA("Checkpoint doesn't match the render settings!");
+		return -1;
+	}
+
+	int restoredCount = 0;
+	uint64 offset = sizeof(header);
+	size_t tileBytes = GetTileBytes(fb);
+	while(true)
+	{
+		CheckpointTileRecord record = {};
+		if(!ReadAt(checkpoint->file, offset, &record, sizeof(record)))
+			break;
+		if(record.tileIndex >= (uint32)checkpoint->tileCount || record.sampleCount != (uint32)settings->samplesPerPixel)
+			break;
+
+		int tileX = record.tileIndex % fb->tilesX;
+		int tileY = record.tileIndex / fb->tilesX;
+		V4 * tile = GetTile(fb, tileX, tileY);
+		if(!ReadAt(checkpoint->file, offset + sizeof(record), tile, (uint32)tileBytes) || ChecksumTileRecord(&record, tile, tileBytes) != record.checksum)
+		{
+			memset(tile, 0, tileBytes);
+			break;
+		}
+		EvictTile(fb, tileX, tileY);
+
+		if(checkpoint->tileStates[record.tileIndex] != TILE_SAVED)
+		{
+			checkpoint->tileStates[record.tileIndex] = TILE_SAVED;
+			checkpoint->tileSeeds[record.tileIndex] = record.seed;
+			restoredCount++;
+		}
+		offset += sizeof(record) + tileBytes;
+	}
+
+	// drop a record torn by the crash, new records go after the last good one
+	LARGE_INTEGER end;
+	end.QuadPart = offset;
+	SetFilePointerEx(checkpoint->file, end, NULL, FILE_BEGIN);
+	SetEndOfFile(checkpoint->file);
+	checkpoint->writeOffset = offset;
+	return restoredCount;
+}
+
+inline bool IsTileSaved(Checkpoint * checkpoint, int tileIndex)
+{
+	return checkpoint->tileStates[tileIndex] == TILE_SAVED;
+}
+
+// called by the worker once the tile is committed to the framebuffer
+inline void MarkTileDone(Checkpoint * checkpoint, int tileIndex, uint32 seed)
+{
+	checkpoint->tileSeeds[tileIndex] = seed;
+	InterlockedExchange(&checkpoint->tileStates[tileIndex], TILE_DONE);
+}
+
+void WriteCheckpoint(Checkpoint * checkpoint)
+{
+	TRACE_SCOPE("WriteCheckpoint");
+	Framebuffer * fb = checkpoint->framebuffer;
+	size_t tileBytes = GetTileBytes(fb);
+	bool written = false;
+	for(int i = 0; i < checkpoint->tileCount; ++i)
+	{
+		if(checkpoint->tileStates[i] != TILE_DONE)
+			continue;
+
+		// finished tiles are never written again, so they can be read without a lock
+		int tileX = i % fb->tilesX;
+		int tileY = i / fb->tilesX;
+		V4 * tile = GetTile(fb, tileX, tileY);
+
+		CheckpointTileRecord record = {};
+		record.tileIndex = i;
+		record.sampleCount = checkpoint->samplesPerPixel;
+		record.seed = checkpoint->tileSeeds[i];
+		record.checksum = ChecksumTileRecord(&record, tile, tileBytes);
+		if(!WriteAt(checkpoint->file, checkpoint->writeOffset, &record, sizeof(record)) ||
+		   !WriteAt(checkpoint->file, checkpoint->writeOffset + sizeof(record), tile, (uint32)tileBytes))
+		{
+			OutputDebugStringA("Failed to write checkpoint!");
+			break;
+		}
+		EvictTile(fb, tileX, tileY);
+
+		checkpoint->writeOffset += sizeof(record) + tileBytes;
+		checkpoint->tileStates[i] = TILE_SAVED;
+		written = true;
+	}
+
+	if(written)
+	{
+		FlushFileBuffers(checkpoint->file);
+	}
+}
+
+DWORD WINAPI CheckpointThreadFunc(LPVOID param)
+{
+	Checkpoint * checkpoint = (Checkpoint*)param;
+	bool stop = false;
+	while(!stop)
+	{
+		stop = WaitForSingleObject(checkpoint->stopEvent, checkpoint->intervalMs) == WAIT_OBJECT_0;
+		WriteCheckpoint(checkpoint);
+	}
+	return 0;
+}
+
+void StartCheckpointThread(Checkpoint * checkpoint)
+{
+	checkpoint->stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	DWORD systemId = 0;
+	checkpoint->thread = CreateThread(NULL, 0, CheckpointThreadFunc, checkpoint, CREATE_SUSPENDED, &systemId);
+	SetTraceThreadName(gThreadCounter, "Checkpoint writer");
+	gThreadIdMap[systemId] = gThreadCounter++;
+	ResumeThread(checkpoint->thread);
+}
+
+// writes whatever finished since the last interval and closes the journal
+void CloseCheckpoint(Checkpoint * checkpoint)
+{
+	if(checkpoint->thread)
+	{
+		SetEvent(checkpoint->stopEvent);
+		WaitForSingleObject(checkpoint->thread, INFINITE);
+		CloseHandle(checkpoint->thread);
+		CloseHandle(checkpoint->stopEvent);
+	}
+	if(checkpoint->file)
+	{
+		CloseHandle(checkpoint->file);
+	}
+	if(checkpoint->tileStates)
+	{
+		TRACKED_DELETE(MEMORY_OTHER, checkpoint->tileStates, checkpoint->tileCount);
+		TRACKED_DELETE(MEMORY_OTHER, checkpoint->tileSeeds, checkpoint->tileCount);
+	}
+	*checkpoint = {};
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Everything the renderer needs, shared by the unity builds of the viewer (main.cpp)
+// and the benchmark runner (bench.cpp).
+
+//#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h> // before Windows.h, which would pull in the old winsock.h
+#include "Windows.h"
+#include <psapi.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <random>
+
+typedef int8_t		int8;
+typedef int16_t		int16;
+typedef int32_t		int32;
+typedef int64_t		int64;
+
+typedef uint8_t		uint8;
+typedef uint16_t	uint16;
+typedef uint32_t	uint32;
+typedef uint64_t	uint64;
+
+typedef uint32_t	uint;
+
+#include "settings.h"
+
+// main thread, render threads and the checkpoint writer
+#define PROGRAM_THREAD_COUNT (MAX_RENDER_THREAD_COUNT + 2)
+uint8 gThreadCounter = 0;
+uint8 gThreadIdMap[1<<16];
+
+struct RNG
+{
+	RNG(int seed = 1147987)
+	{
+		generator = std::mt19937(seed);
+	}
+
+	float Next(float min, float max)
+	{
+		std::uniform_real_distribution<float> distribution(min, max);
+		return distribution(generator);
+	}
+
+	std::mt19937 generator;
+};
+
+RNG gPerThreadRng[PROGRAM_THREAD_COUNT];
+
+#define LOCAL_THREAD_ID (gThreadIdMap[GetCurrentThreadId()])
+// #define LOCAL_THREAD_ID 0
+
+#include "profile.h"
+#include "arena.h"
+#include "trace.h"
+#include "raystats.h"
+#include "math.h"
+#include "geometry.h"
+#include "sampler.h"
+#include "camera.h"
+#include "object.h"
+#include "scene.h"
+#include "scenegen.h"
+#include "framebuffer.h"
+#include "imagewriter.h"
+#include "heatmap.h"
+#include "checkpoint.h"
+#include "render.h"
+#include "display.h"
+#include "metrics.h"
+#include "threading.h"
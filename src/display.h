@@ -0,0 +1,72 @@
+#pragma once
+
+#define MAX_DISPLAY_WIDTH 1280
+#define MAX_DISPLAY_HEIGHT 768
+
+// NOTE: tone mapped preview of the framebuffer, point sampled down to fit the window.
+// Tiles are resolved by the worker that finished them, so painting never has to
+// read (or page back in) the HDR framebuffer.
+struct Display
+{
+	int width;
+	int height;
+	int scale;
+	uint32 * pixels;
+};
+
+void InitDisplay(Display * display, int imageWidth, int imageHeight)
+{
+	int scaleX = (imageWidth + MAX_DISPLAY_WIDTH - 1) / MAX_DISPLAY_WIDTH;
+	int scaleY = (imageHeight + MAX_DISPLAY_HEIGHT - 1) / MAX_DISPLAY_HEIGHT;
+	display->scale = max(scaleX, scaleY);
+	display->width = (imageWidth + display->scale - 1) / display->scale;
+	display->height = (imageHeight + display->scale - 1) / display->scale;
+	display->pixels = TRACKED_NEW(MEMORY_FRAMEBUFFER, uint32, display->width * display->height);
+	memset(display->pixels, 0, display->width * display->height * sizeof(uint32));
+}
+
+void FreeDisplay(Display * display)
+{
+	if(display->pixels)
+	{
+		TRACKED_DELETE(MEMORY_FRAMEBUFFER, display->pixels, display->width * display->height);
+	}
+	*display = {};
+}
+
+uint32 ToneMap(V4 sample)
+{
+	// tone mapping
+	float luminance = 0.2126f*sample.r + 0.7152f*sample.g + 0.0722f*sample.b;
+	float whitepoint = 0.6f;
+	{
+		sample = ComponentDivide(ComponentDivide(sample, (sample + V4{1, 1, 1, 1})*whitepoint), V4{whitepoint, whitepoint, whitepoint, whitepoint} + V4{1, 1, 1, 1});
+	}
+	sample = Saturate(sample);
+
+	// gamma
+	{
+		sample.r = (float)pow(sample.r, 0.45f);
+		sample.g = (float)pow(sample.g, 0.45f);
+		sample.b = (float)pow(sample.b, 0.45f);
+	}
+	return RGBA32(sample.r, sample.g, sample.b, sample.a);
+}
+
+// tile covers image pixels [x0, x1) x [y0, y1), stored with a stride of tileSize
+void ResolveTile(Display * display, V4 * tile, int tileSize, int x0, int y0, int x1, int y1)
+{
+	int scale = display->scale;
+	int dx0 = (x0 + scale - 1) / scale;
+	int dy0 = (y0 + scale - 1) / scale;
+	int dx1 = (x1 + scale - 1) / scale;
+	int dy1 = (y1 + scale - 1) / scale;
+	for(int dy = dy0; dy < dy1; ++dy)
+	{
+		V4 * row = tile + (dy*scale - y0) * tileSize;
+		for(int dx = dx0; dx < dx1; ++dx)
+		{
+			display->pixels[dy * display->width + dx] = ToneMap(row[dx*scale - x0]);
+		}
+	}
+}
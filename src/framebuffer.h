@@ -0,0 +1,139 @@
+#pragma once
+
+#define FRAMEBUFFER_TILE_SIZE 64
+
+// NOTE: tile-major layout. Every tile, including the partial ones on the right and
+// bottom edges, occupies a full tileSize*tileSize block, so a finished tile is
+// committed with one contiguous copy and neighbouring tiles never share a cache line.
+struct Framebuffer
+{
+	int width;
+	int height;
+	int tileSize;
+	int tilesX;
+	int tilesY;
+	V4 * pixels;
+
+	// out-of-core backend, see InitFramebufferMapped
+	HANDLE file;
+	HANDLE mapping;
+};
+
+inline size_t GetTileBytes(Framebuffer * fb)
+{
+	return (size_t)fb->tileSize * fb->tileSize * sizeof(V4);
+}
+
+void InitFramebuffer(Framebuffer * fb, int width, int height, int tileSize)
+{
+	fb->width = width;
+	fb->height = height;
+	fb->tileSize = tileSize;
+	fb->tilesX = (width + tileSize - 1) / tileSize;
+	fb->tilesY = (height + tileSize - 1) / tileSize;
+
+	fb->file = NULL;
+	fb->mapping = NULL;
+
+	// page aligned and zeroed
+	size_t size = (size_t)fb->tilesX * fb->tilesY * GetTileBytes(fb);
+	fb->pixels = (V4*)VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	TRACK_ALLOC(MEMORY_FRAMEBUFFER, size);
+}
+
+// NOTE: framebuffer backed by a memory mapped file, for images that don't fit in RAM.
+// With 64x64 tiles of V4 every tile is exactly 64KB, so tiles are page (and allocation
+// granularity) aligned. Finished tiles are flushed and trimmed from the working set in
+// CommitTile, which is the Windows counterpart of madvise(MADV_DONTNEED) on a shared mapping.
+bool InitFramebufferMapped(Framebuffer * fb, int width, int height, int tileSize, const char * path)
+{
+	*fb = {};
+	fb->width = width;
+	fb->height = height;
+	fb->tileSize = tileSize;
+	fb->tilesX = (width + tileSize - 1) / tileSize;
+	fb->tilesY = (height + tileSize - 1) / tileSize;
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	if(GetTileBytes(fb) % info.dwPageSize != 0)
+	{
+		OutputDebugStringA("Framebuffer tiles must be page aligned!");
+		return false;
+	}
+
+	uint64 size = (uint64)fb->tilesX * fb->tilesY * GetTileBytes(fb);
+	fb->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(fb->file == INVALID_HANDLE_VALUE)
+	{
+		OutputDebugStringA("Failed to create framebuffer file!");
+		fb->file = NULL;
+		return false;
+	}
+
+	fb->mapping = CreateFileMappingA(fb->file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)(size & 0xffffffff), NULL);
+	if(fb->mapping)
+	{
+		fb->pixels = (V4*)MapViewOfFile(fb->mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	}
+
+	if(!fb->pixels)
+	{
+		OutputDebugStringA("Failed to map framebuffer file!");
+		if(fb->mapping) CloseHandle(fb->mapping);
+		CloseHandle(fb->file);
+		*fb = {};
+		return false;
+	}
+	TRACK_ALLOC(MEMORY_MAPPED_FRAMEBUFFER, (size_t)size);
+	return true;
+}
+
+void FreeFramebuffer(Framebuffer * fb)
+{
+	size_t size = (size_t)fb->tilesX * fb->tilesY * GetTileBytes(fb);
+	if(fb->mapping)
+	{
+		UnmapViewOfFile(fb->pixels);
+		CloseHandle(fb->mapping);
+		CloseHandle(fb->file);
+		TRACK_FREE(MEMORY_MAPPED_FRAMEBUFFER, size);
+	}
+	else if(fb->pixels)
+	{
+		VirtualFree(fb->pixels, 0, MEM_RELEASE);
+		TRACK_FREE(MEMORY_FRAMEBUFFER, size);
+	}
+	*fb = {};
+}
+
+inline V4 * GetTile(Framebuffer * fb, int tileX, int tileY)
+{
+	size_t tileIndex = (size_t)tileY * fb->tilesX + tileX;
+	return fb->pixels + tileIndex * fb->tileSize * fb->tileSize;
+}
+
+inline V4 GetPixel(Framebuffer * fb, int x, int y)
+{
+	V4 * tile = GetTile(fb, x / fb->tileSize, y / fb->tileSize);
+	return tile[(y % fb->tileSize) * fb->tileSize + (x % fb->tileSize)];
+}
+
+// Only does something for the mapped backend: starts writing the tile back and drops it
+// from the working set, VirtualUnlock on pages that aren't locked does exactly that.
+void EvictTile(Framebuffer * fb, int tileX, int tileY)
+{
+	if(fb->mapping)
+	{
+		TRACE_TILE_SCOPE("EvictTile", tileX, tileY);
+		V4 * tile = GetTile(fb, tileX, tileY);
+		FlushViewOfFile(tile, GetTileBytes(fb));
+		VirtualUnlock(tile, GetTileBytes(fb));
+	}
+}
+
+void CommitTile(Framebuffer * fb, int tileX, int tileY, V4 * tilePixels)
+{
+	memcpy(GetTile(fb, tileX, tileY), tilePixels, GetTileBytes(fb));
+	EvictTile(fb, tileX, tileY);
+}
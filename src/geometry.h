@@ -56,10 +56,18 @@ struct Vertex
 	V3 normal;
 };
 
+// Indexed triangles. Intersection reads only the indices and the full precision positions,
+// the normals are read for the hit and interpolated across the triangle. Indices are 16 bit
+// when every vertex fits, normals are either V3s or octahedral encoded in 32 bits.
 struct Mesh
 {
-	int vertexCount;
-	Vertex * vertices;
+	V3 * positions;
+	void * normals; // V3, or uint32 when octNormals
+	void * indices; // three per triangle, uint16 when shortIndices, uint32 otherwise
+	uint vertexCount;
+	uint triangleCount;
+	bool shortIndices;
+	bool octNormals;
 	Sphere bound;
 	AABB aabb;
 };
@@ -73,17 +81,6 @@ enum GeoType
 	COUNT
 };
 
-struct Geometry
-{
-	GeoType type;
-	union
-	{
-		Sphere sphere;
-		Plane plane;
-		Mesh mesh;
-	};
-};
-
 struct Intersection
 {
 	V3 point;
@@ -91,19 +88,92 @@ struct Intersection
 	float t;
 };
 
+// Unit vector folded onto the octahedron and projected to its xy plane, the lower half
+// mirrored over the diagonals, both components as 16 bit snorm. Worst case error is
+// about 0.004 degrees.
+uint32 EncodeOctahedral(V3 n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float u = n.x / l1;
+	float v = n.y / l1;
+	if(n.z < 0.0f)
+	{
+		float mu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float mv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = mu;
+		v = mv;
+	}
+	int16 qu = (int16)roundf(Clamp(u, -1.0f, 1.0f) * 32767.0f);
+	int16 qv = (int16)roundf(Clamp(v, -1.0f, 1.0f) * 32767.0f);
+	return (uint32)(uint16)qu | ((uint32)(uint16)qv << 16);
+}
+
+V3 DecodeOctahedral(uint32 e)
+{
+	float u = (int16)(e & 0xFFFF) / 32767.0f;
+	float v = (int16)(e >> 16) / 32767.0f;
+	V3 n = {u, v, 1.0f - fabsf(u) - fabsf(v)};
+	if(n.z < 0.0f)
+	{
+		n.x = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+	}
+	return Normalize(n);
+}
+
+inline V3 GetMeshNormal(Mesh * mesh, uint vertex)
+{
+	if(mesh->octNormals)
+	{
+		return DecodeOctahedral(((uint32*)mesh->normals)[vertex]);
+	}
+	return ((V3*)mesh->normals)[vertex];
+}
+
+inline void SetMeshNormal(Mesh * mesh, uint vertex, V3 normal)
+{
+	if(mesh->octNormals)
+	{
+		((uint32*)mesh->normals)[vertex] = EncodeOctahedral(normal);
+	}
+	else
+	{
+		((V3*)mesh->normals)[vertex] = normal;
+	}
+}
+
+inline void SetMeshTriangle(Mesh * mesh, uint triangle, uint i0, uint i1, uint i2)
+{
+	if(mesh->shortIndices)
+	{
+		uint16 * indices = (uint16*)mesh->indices + 3*triangle;
+		indices[0] = (uint16)i0;
+		indices[1] = (uint16)i1;
+		indices[2] = (uint16)i2;
+	}
+	else
+	{
+		uint32 * indices = (uint32*)mesh->indices + 3*triangle;
+		indices[0] = i0;
+		indices[1] = i1;
+		indices[2] = i2;
+	}
+}
+
 void ComputeMeshBound(Mesh * mesh)
 {
+	TRACE_SCOPE("ComputeMeshBound");
 	V3 min = V3::FloatMax();
 	V3 max = V3::FloatMin();
-	for(int i = 0; i < mesh->vertexCount; ++i)
+	for(uint i = 0; i < mesh->vertexCount; ++i)
 	{
-		Vertex * v = &mesh->vertices[i];
-		if(min.x > v->position.x) min.x = v->position.x;
-		if(min.y > v->position.y) min.y = v->position.y;
-		if(min.z > v->position.z) min.z = v->position.z;
-		if(max.x < v->position.x) max.x = v->position.x;
-		if(max.y < v->position.y) max.y = v->position.y;
-		if(max.z < v->position.z) max.z = v->position.z;
+		V3 p = mesh->positions[i];
+		if(min.x > p.x) min.x = p.x;
+		if(min.y > p.y) min.y = p.y;
+		if(min.z > p.z) min.z = p.z;
+		if(max.x < p.x) max.x = p.x;
+		if(max.y < p.y) max.y = p.y;
+		if(max.z < p.z) max.z = p.z;
 	}
 	mesh->aabb.min = min;
 	mesh->aabb.max = max;
@@ -115,6 +185,7 @@ void ComputeMeshBound(Mesh * mesh)
 bool IntersectRaySphere(Ray ray, Sphere sphere, Intersection * intersection)
 {
 // PROFILED_FUNCTION_FAST;
+	COUNT_PRIMITIVE_TESTS(1);
 	// See Real-Time Rendering 3rd ed., p. 741
 	V3 l = sphere.o - ray.o;
 	float s = Dot(l, ray.d);
@@ -160,6 +231,7 @@ bool TestRaySphere(Ray ray, Sphere sphere)
 bool TestRayAABB(Ray ray, AABB aabb)
 {
 	PROFILED_FUNCTION_FAST;
+	COUNT_BOX_TESTS(1);
 	// NOTE: cheating! Represent ray as a very long line segment
 
 	V3 offset = -(aabb.min + aabb.max) * 0.5f;
@@ -185,6 +257,7 @@ bool TestRayAABB(Ray ray, AABB aabb)
 bool IntersectRayPlane(Ray ray, Plane plane, Intersection * intersection)
 {
 // PROFILED_FUNCTION_FAST;
+	COUNT_PRIMITIVE_TESTS(1);
 	bool result = false;
 	float denom = Dot(ray.d, -plane.n);
 	if(denom > EPSYLON)
@@ -205,23 +278,29 @@ bool IntersectRayPlane(Ray ray, Plane plane, Intersection * intersection)
 	return result;
 }
 
-bool IntersectRayMesh(Ray ray, Mesh mesh, Intersection * intersection)
+// Nearest hit closer than intersection->t, which the caller sets to the closest hit so far
+// (or FLOAT_MAX). Without an intersection it only tells whether the ray hits at all.
+template<typename Index>
+bool IntersectRayTriangles(Ray ray, Mesh * mesh, Index * indices, Intersection * intersection)
 {
- PROFILED_FUNCTION_FAST;
 	bool result = false;
-	for(int i = 0; i < mesh.vertexCount; i += 3)
+	uint hit = 0;
+	float hitT = intersection ? intersection->t : FLOAT_MAX;
+	float hitU = 0.0f;
+	float hitV = 0.0f;
+	for(uint i = 0; i < mesh->triangleCount; ++i)
 	{
-		Vertex v0 = mesh.vertices[i + 0];
-		Vertex v1 = mesh.vertices[i + 1];
-		Vertex v2 = mesh.vertices[i + 2];
-		V3 edge1 = v1.position - v0.position;
-		V3 edge2 = v2.position - v0.position;
+		V3 p0 = mesh->positions[indices[3*i + 0]];
+		V3 p1 = mesh->positions[indices[3*i + 1]];
+		V3 p2 = mesh->positions[indices[3*i + 2]];
+		V3 edge1 = p1 - p0;
+		V3 edge2 = p2 - p0;
 		V3 h = Cross(ray.d, edge2);
 		float a = Dot(edge1, h);
 		if(fabs(a) > EPSYLON)
 		{
 			float f = 1.0f/a;
-			V3 s = ray.o - v0.position;
+			V3 s = ray.o - p0;
 			float u = f*Dot(s, h);
 			if(Saturate(u) == u)
 			{
@@ -231,64 +310,52 @@ bool IntersectRayMesh(Ray ray, Mesh mesh, Intersection * intersection)
 				{
 					float t = f*Dot(edge2, q);
 					// TODO: add this test to all intersections, remove ray origin shifting from main
-					if(t > EPSYLON)
+					if(t > EPSYLON && t < hitT)
 					{
 						result = true;
-						if(intersection)
-						{
-							(*intersection).t = t;
-							(*intersection).point = ray.o + ray.d*t;
-							(*intersection).normal = v0.normal;
-						}
+						hit = i;
+						hitT = t;
+						hitU = u;
+						hitV = v;
 					}
 				}
 			}
 		}
 	}
+
+	if(result && intersection)
+	{
+		V3 n0 = GetMeshNormal(mesh, indices[3*hit + 0]);
+		V3 n1 = GetMeshNormal(mesh, indices[3*hit + 1]);
+		V3 n2 = GetMeshNormal(mesh, indices[3*hit + 2]);
+		(*intersection).t = hitT;
+		(*intersection).point = ray.o + ray.d*hitT;
+		(*intersection).normal = Normalize(n0*(1.0f - hitU - hitV) + n1*hitU + n2*hitV);
+	}
 	return result;
 }
 
-bool TryIntersectRayMesh(Ray ray, Mesh mesh, Intersection * intersection)
+bool IntersectRayMesh(Ray ray, Mesh * mesh, Intersection * intersection)
 {
-	bool result = false;
-	//return IntersectRaySphere(ray, mesh.bound, intersection);
-	//if(TestRaySphere(ray, mesh.bound))
+ PROFILED_FUNCTION_FAST;
+	COUNT_PRIMITIVE_TESTS(mesh->triangleCount);
+	if(mesh->shortIndices)
 	{
-		if(TestRayAABB(ray, mesh.aabb))
-		{
-			result = IntersectRayMesh(ray, mesh, intersection);
-		}
+		return IntersectRayTriangles(ray, mesh, (uint16*)mesh->indices, intersection);
 	}
-	return result;
+	return IntersectRayTriangles(ray, mesh, (uint32*)mesh->indices, intersection);
 }
 
-bool Intersect(Ray ray, Geometry geo, Intersection * ix)
+bool TryIntersectRayMesh(Ray ray, Mesh * mesh, Intersection * intersection)
 {
-// PROFILED_FUNCTION_FAST;
 	bool result = false;
-	switch(geo.type)
+	//return IntersectRaySphere(ray, mesh->bound, intersection);
+	//if(TestRaySphere(ray, mesh->bound))
 	{
-		case GeoType::SPHERE:
-		{
-			result = IntersectRaySphere(ray, geo.sphere, ix);
-		} break;
-
-		case GeoType::PLANE:
-		{
-			result = IntersectRayPlane(ray, geo.plane, ix);
-		} break;
-
-		case GeoType::MESH:
+		if(TestRayAABB(ray, mesh->aabb))
 		{
-			result = TryIntersectRayMesh(ray, geo.mesh, ix);
-		} break;
-
-		default:
-		{
-
-		} break;
+			result = IntersectRayMesh(ray, mesh, intersection);
+		}
 	}
-
 	return result;
 }
-
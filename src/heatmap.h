@@ -0,0 +1,102 @@
+#pragma once
+
+// Per-pixel render cost. Stored like the framebuffer, one V4 per pixel in tiles:
+// r = cycles, g = rays traced (all types), b = cycles per ray, a = 1.
+// The raw values are written with the image writer (.exr or .pfm), and a false colour
+// .bmp of the cycles goes next to it.
+
+// log scaled, so a handful of very expensive pixels doesn't flatten everything else
+V4 HeatmapColor(float value, float maxValue)
+{
+	V4 gradient[] = {
+		{0.0f, 0.0f, 0.5f, 1.0f},
+		{0.0f, 0.5f, 1.0f, 1.0f},
+		{0.0f, 1.0f, 0.5f, 1.0f},
+		{1.0f, 1.0f, 0.0f, 1.0f},
+		{1.0f, 0.0f, 0.0f, 1.0f},
+	};
+	const int stopCount = sizeof(gradient) / sizeof(gradient[0]);
+
+	float t = maxValue > 1.0f ? (float)(log(1.0f + value) / log(1.0f + maxValue)) : 0.0f;
+	t = Clamp(t, 0.0f, 1.0f) * (stopCount - 1);
+	int i = min((int)t, stopCount - 2);
+	float f = t - i;
+	return gradient[i] * (1.0f - f) + gradient[i + 1] * f;
+}
+
+bool WriteHeatmapBMP(Framebuffer * heatmap, const char * path)
+{
+	float maxCycles = 0.0f;
+	for(int y = 0; y < heatmap->height; ++y)
+	{
+		for(int x = 0; x < heatmap->width; ++x)
+		{
+			maxCycles = max(maxCycles, GetPixel(heatmap, x, y).r);
+		}
+	}
+
+	// 24 bit, bottom-up rows padded to 4 bytes
+	uint rowSize = (heatmap->width * 3 + 3) & ~3u;
+	uint imageSize = rowSize * heatmap->height;
+	HeaderBuffer header = {};
+	PutByte(&header, 'B'); PutByte(&header, 'M');
+	PutInt(&header, 14 + 40 + imageSize); // file size
+	PutInt(&header, 0); // reserved
+	PutInt(&header, 14 + 40); // pixel data offset
+	PutInt(&header, 40); // BITMAPINFOHEADER
+	PutInt(&header, heatmap->width);
+	PutInt(&header, heatmap->height);
+	PutByte(&header, 1); PutByte(&header, 0); // planes
+	PutByte(&header, 24); PutByte(&header, 0); // bits per pixel
+	PutInt(&header, 0); // BI_RGB
+	PutInt(&header, imageSize);
+	PutInt(&header, 2835); PutInt(&header, 2835); // 72 dpi
+	PutInt(&header, 0); PutInt(&header, 0);
+
+	FILE * file = fopen(path, "wb");
+	if(!file)
+	{
+		OutputDebugStringA("Failed to write heatmap!");
+		return false;
+	}
+	fwrite(header.data, 1, header.size, file);
+
+	uint8 * row = TRACKED_NEW(MEMORY_IO, uint8, rowSize);
+	memset(row, 0, rowSize);
+	for(int y = heatmap->height - 1; y >= 0; --y)
+	{
+		for(int x = 0; x < heatmap->width; ++x)
+		{
+			V4 color = HeatmapColor(GetPixel(heatmap, x, y).r, maxCycles);
+			row[x*3 + 0] = (uint8)(color.b * 255);
+			row[x*3 + 1] = (uint8)(color.g * 255);
+			row[x*3 + 2] = (uint8)(color.r * 255);
+		}
+		fwrite(row, 1, rowSize, file);
+	}
+	TRACKED_DELETE(MEMORY_IO, row, rowSize);
+	fclose(file);
+	return true;
+}
+
+// raw values to path (.exr or .pfm), false colour to path with the extension replaced by .bmp
+bool WriteHeatmap(Framebuffer * heatmap, const char * path)
+{
+	if(!WriteImage(heatmap, path))
+	{
+		return false;
+	}
+
+	char bmpPath[MAX_PATH];
+	_snprintf(bmpPath, MAX_PATH, "%s", path);
+	bmpPath[MAX_PATH - 1] = 0;
+	char * extension = strrchr(bmpPath, '.');
+	if(extension && !strpbrk(extension, "\\/"))
+	{
+		*extension = 0;
+	}
+	size_t length = strlen(bmpPath);
+	_snprintf(bmpPath + length, MAX_PATH - length, ".bmp");
+	bmpPath[MAX_PATH - 1] = 0;
+	return WriteHeatmapBMP(heatmap, bmpPath);
+}
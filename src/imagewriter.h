@@ -0,0 +1,367 @@
+#pragma once
+
+// Streams finished tiles straight to disk from the thread that rendered them.
+// Both formats have a layout that is known up front (uncompressed tiled OpenEXR,
+// or PFM scanlines), so every tile lands at a precomputed file offset and no
+// full-image staging buffer is needed.
+
+enum ImageFormat
+{
+	IMAGE_FORMAT_EXR,
+	IMAGE_FORMAT_PFM,
+};
+
+struct ImageWriter
+{
+	HANDLE file;
+	ImageFormat format;
+	int width;
+	int height;
+	int tileSize;
+	int tilesX;
+	int tilesY;
+	uint64 headerSize;
+	uint64 * tileOffsets; // EXR only: file offset of each tile chunk, x fastest
+	volatile LONG failedWrites; // tile writes come from the render threads, reported on close
+};
+
+// NOTE: positioned I/O on a synchronous handle, safe to issue from several threads
+bool WriteAt(HANDLE file, uint64 offset, const void * data, uint32 size)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD written = 0;
+	return WriteFile(file, data, size, &written, &overlapped) && written == size;
+}
+
+bool ReadAt(HANDLE file, uint64 offset, void * data, uint32 size)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD read = 0;
+	return ReadFile(file, data, size, &read, &overlapped) && read == size;
+}
+
+ImageFormat ImageFormatFromPath(const char * path)
+{
+	size_t length = strlen(path);
+	if(length >= 4 && _stricmp(path + length - 4, ".pfm") == 0)
+	{
+		return IMAGE_FORMAT_PFM;
+	}
+	return IMAGE_FORMAT_EXR;
+}
+
+/* OpenEXR */
+
+struct HeaderBuffer
+{
+	uint8 data[1024];
+	uint size;
+};
+
+void Put(HeaderBuffer * buffer, const void * data, uint size)
+{
+	assert(buffer->size + size <= sizeof(buffer->data));
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+}
+
+void PutString(HeaderBuffer * buffer, const char * s)
+{
+	Put(buffer, s, (uint)strlen(s) + 1);
+}
+
+void PutInt(HeaderBuffer * buffer, int32 value) { Put(buffer, &value, sizeof(value)); }
+void PutFloat(HeaderBuffer * buffer, float value) { Put(buffer, &value, sizeof(value)); }
+void PutByte(HeaderBuffer * buffer, uint8 value) { Put(buffer, &value, sizeof(value)); }
+
+void PutAttribute(HeaderBuffer * buffer, const char * name, const char * type, int32 size)
+{
+	PutString(buffer, name);
+	PutString(buffer, type);
+	PutInt(buffer, size);
+}
+
+int GetTileWidth(ImageWriter * writer, int tileX)
+{
+	return min(writer->tileSize, writer->width - tileX * writer->tileSize);
+}
+
+int GetTileHeight(ImageWriter * writer, int tileY)
+{
+	return min(writer->tileSize, writer->height - tileY * writer->tileSize);
+}
+
+// See "Reading and Writing OpenEXR Image Files", file layout chapter. Uncompressed,
+// single level, FLOAT B/G/R channels (channels are stored in alphabetical order).
+uint64 WriteEXRHeader(ImageWriter * writer)
+{
+	HeaderBuffer header = {};
+	PutInt(&header, 20000630); // magic
+	PutInt(&header, 2 | 0x200); // version 2, tiled
+
+	const char * channels[] = {"B", "G", "R"};
+	PutAttribute(&header, "channels", "chlist", 3 * (2 + 16) + 1);
+	for(int i = 0; i < 3; ++i)
+	{
+		PutString(&header, channels[i]);
+		PutInt(&header, 2); // FLOAT
+		PutByte(&header, 0); // pLinear
+		PutByte(&header, 0); PutByte(&header, 0); PutByte(&header, 0); // reserved
+		PutInt(&header, 1); // xSampling
+		PutInt(&header, 1); // ySampling
+	}
+	PutByte(&header, 0);
+
+	PutAttribute(&header, "compression", "compression", 1);
+	PutByte(&header, 0); // NO_COMPRESSION
+
+	PutAttribute(&header, "dataWindow", "box2i", 16);
+	PutInt(&header, 0); PutInt(&header, 0); PutInt(&header, writer->width - 1); PutInt(&header, writer->height - 1);
+
+	PutAttribute(&header, "displayWindow", "box2i", 16);
+	PutInt(&header, 0); PutInt(&header, 0); PutInt(&header, writer->width - 1); PutInt(&header, writer->height - 1);
+
+	PutAttribute(&header, "lineOrder", "lineOrder", 1);
+	PutByte(&header, 0); // INCREASING_Y
+
+	PutAttribute(&header, "pixelAspectRatio", "float", 4);
+	PutFloat(&header, 1.0f);
+
+	PutAttribute(&header, "screenWindowCenter", "v2f", 8);
+	PutFloat(&header, 0.0f); PutFloat(&header, 0.0f);
+
+	PutAttribute(&header, "screenWindowWidth", "float", 4);
+	PutFloat(&header, 1.0f);
+
+	PutAttribute(&header, "tiles", "tiledesc", 9);
+	PutInt(&header, writer->tileSize);
+	PutInt(&header, writer->tileSize);
+	PutByte(&header, 0); // ONE_LEVEL, ROUND_DOWN
+
+	PutByte(&header, 0); // end of header
+
+	// offset table is followed by the tile chunks, in the same order
+	int tileCount = writer->tilesX * writer->tilesY;
+	uint64 offset = header.size + tileCount * sizeof(uint64);
+	for(int ty = 0; ty < writer->tilesY; ++ty)
+	{
+		for(int tx = 0; tx < writer->tilesX; ++tx)
+		{
+			writer->tileOffsets[ty * writer->tilesX + tx] = offset;
+			offset += 5 * sizeof(int32) + GetTileWidth(writer, tx) * GetTileHeight(writer, ty) * 3 * sizeof(float);
+		}
+	}
+
+	bool ok = WriteAt(writer->file, 0, header.data, header.size);
+	ok = ok && WriteAt(writer->file, header.size, writer->tileOffsets, tileCount * sizeof(uint64));
+	return ok ? offset : 0;
+}
+
+void WriteEXRTile(ImageWriter * writer, int tileX, int tileY, V4 * tilePixels)
+{
+	int w = GetTileWidth(writer, tileX);
+	int h = GetTileHeight(writer, tileY);
+	uint dataSize = w * h * 3 * sizeof(float);
+	uint chunkSize = 5 * sizeof(int32) + dataSize;
+
+	uint8 * chunk = TRACKED_NEW(MEMORY_IO, uint8, chunkSize);
+	int32 * chunkHeader = (int32*)chunk;
+	chunkHeader[0] = tileX;
+	chunkHeader[1] = tileY;
+	chunkHeader[2] = 0; // level x
+	chunkHeader[3] = 0; // level y
+	chunkHeader[4] = dataSize;
+
+	float * out = (float*)(chunk + 5 * sizeof(int32));
+	for(int y = 0; y < h; ++y)
+	{
+		V4 * row = tilePixels + y * writer->tileSize;
+		for(int x = 0; x < w; ++x) *out++ = row[x].b;
+		for(int x = 0; x < w; ++x) *out++ = row[x].g;
+		for(int x = 0; x < w; ++x) *out++ = row[x].r;
+	}
+
+	if(!WriteAt(writer->file, writer->tileOffsets[tileY * writer->tilesX + tileX], chunk, chunkSize))
+	{
+		InterlockedIncrement(&writer->failedWrites);
+	}
+	TRACKED_DELETE(MEMORY_IO, chunk, chunkSize);
+}
+
+/* PFM */
+
+uint64 WritePFMHeader(ImageWriter * writer)
+{
+	char header[64];
+	int length = _snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", writer->width, writer->height);
+	if(!WriteAt(writer->file, 0, header, length))
+	{
+		return 0;
+	}
+	writer->headerSize = length;
+	return length + (uint64)writer->width * writer->height * 3 * sizeof(float);
+}
+
+void WritePFMTile(ImageWriter * writer, int tileX, int tileY, V4 * tilePixels)
+{
+	int w = GetTileWidth(writer, tileX);
+	int h = GetTileHeight(writer, tileY);
+	float * rowData = TRACKED_NEW(MEMORY_IO, float, w * 3);
+	for(int y = 0; y < h; ++y)
+	{
+		V4 * row = tilePixels + y * writer->tileSize;
+		for(int x = 0; x < w; ++x)
+		{
+			rowData[x*3 + 0] = row[x].r;
+			rowData[x*3 + 1] = row[x].g;
+			rowData[x*3 + 2] = row[x].b;
+		}
+
+		// PFM scanlines go bottom to top
+		int imageX = tileX * writer->tileSize;
+		int imageY = tileY * writer->tileSize + y;
+		uint64 offset = writer->headerSize + ((uint64)(writer->height - 1 - imageY) * writer->width + imageX) * 3 * sizeof(float);
+		if(!WriteAt(writer->file, offset, rowData, w * 3 * sizeof(float)))
+		{
+			InterlockedIncrement(&writer->failedWrites);
+		}
+	}
+	TRACKED_DELETE(MEMORY_IO, rowData, w * 3);
+}
+
+// reads a little endian RGB image written by WritePFMTile into fb, which must already be
+// initialized at the same size
+bool ReadPFM(const char * path, Framebuffer * fb)
+{
+	FILE * file = fopen(path, "rb");
+	if(!file)
+	{
+		return false;
+	}
+	int width = 0, height = 0;
+	float scale = 0.0f;
+	if(fscanf(file, "PF %d %d %f", &width, &height, &scale) != 3 || fgetc(file) != '\n' ||
+	   width != fb->width || height != fb->height || scale >= 0.0f)
+	{
+		OutputDebugStringA("Unexpected PFM header!");
+		fclose(file);
+		return false;
+	}
+
+	bool result = true;
+	float * rowData = TRACKED_NEW(MEMORY_IO, float, width * 3);
+	for(int y = height - 1; y >= 0 && result; --y)
+	{
+		result = fread(rowData, sizeof(float), width * 3, file) == (size_t)width * 3;
+		for(int x = 0; x < width && result; ++x)
+		{
+			V4 * tile = GetTile(fb, x / fb->tileSize, y / fb->tileSize);
+			tile[(y % fb->tileSize) * fb->tileSize + (x % fb->tileSize)] = V4{rowData[x*3 + 0], rowData[x*3 + 1], rowData[x*3 + 2], 1.0f};
+		}
+	}
+	TRACKED_DELETE(MEMORY_IO, rowData, width * 3);
+	fclose(file);
+	return result;
+}
+
+/* Writer */
+
+// false when any tile failed to write, the image on disk is incomplete then
+bool CloseImageWriter(ImageWriter * writer)
+{
+	bool result = writer->failedWrites == 0;
+	if(!result)
+	{
+		OutputDebugStringA("Failed to write output image tiles!");
+	}
+	if(writer->file)
+	{
+		CloseHandle(writer->file);
+	}
+	if(writer->tileOffsets)
+	{
+		TRACKED_DELETE(MEMORY_IO, writer->tileOffsets, writer->tilesX * writer->tilesY);
+	}
+	*writer = {};
+	return result;
+}
+
+bool OpenImageWriter(ImageWriter * writer, const char * path, int width, int height, int tileSize)
+{
+	*writer = {};
+	writer->format = ImageFormatFromPath(path);
+	writer->width = width;
+	writer->height = height;
+	writer->tileSize = tileSize;
+	writer->tilesX = (width + tileSize - 1) / tileSize;
+	writer->tilesY = (height + tileSize - 1) / tileSize;
+
+	writer->file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(writer->file == INVALID_HANDLE_VALUE)
+	{
+		OutputDebugStringA("Failed to create output image!");
+		writer->file = NULL;
+		return false;
+	}
+
+	uint64 fileSize = 0;
+	if(writer->format == IMAGE_FORMAT_EXR)
+	{
+		writer->tileOffsets = TRACKED_NEW(MEMORY_IO, uint64, writer->tilesX * writer->tilesY);
+		fileSize = WriteEXRHeader(writer);
+	}
+	else
+	{
+		fileSize = WritePFMHeader(writer);
+	}
+
+	if(fileSize == 0)
+	{
+		OutputDebugStringA("Failed to write output image header!");
+		CloseImageWriter(writer);
+		return false;
+	}
+
+	// reserve the whole file so tiles can land anywhere in it
+	LARGE_INTEGER end;
+	end.QuadPart = fileSize;
+	SetFilePointerEx(writer->file, end, NULL, FILE_BEGIN);
+	SetEndOfFile(writer->file);
+	return true;
+}
+
+void WriteImageTile(ImageWriter * writer, int tileX, int tileY, V4 * tilePixels)
+{
+PROFILED_FUNCTION;
+	TRACE_TILE_SCOPE("WriteImageTile", tileX, tileY);
+	if(writer->format == IMAGE_FORMAT_EXR)
+	{
+		WriteEXRTile(writer, tileX, tileY, tilePixels);
+	}
+	else
+	{
+		WritePFMTile(writer, tileX, tileY, tilePixels);
+	}
+}
+
+// the whole framebuffer in one go, for images that are finished before they are written
+bool WriteImage(Framebuffer * fb, const char * path)
+{
+	ImageWriter writer;
+	if(!OpenImageWriter(&writer, path, fb->width, fb->height, fb->tileSize))
+	{
+		return false;
+	}
+	for(int tileY = 0; tileY < fb->tilesY; ++tileY)
+	{
+		for(int tileX = 0; tileX < fb->tilesX; ++tileX)
+		{
+			WriteImageTile(&writer, tileX, tileY, GetTile(fb, tileX, tileY));
+		}
+	}
+	return CloseImageWriter(&writer);
+}
@@ -89,6 +89,14 @@ inline float Max(float a, float b, float c)
 	return Max(Max(a, b), c);
 }
 
+// ascending, for qsort
+inline int CompareDoubles(const void * a, const void * b)
+{
+	double x = *(double*)a;
+	double y = *(double*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
 /* Vector 2D */
 union V2
 {
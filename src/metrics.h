@@ -0,0 +1,262 @@
+#pragma once
+
+// Live render counters served over HTTP on localhost in the Prometheus text format,
+// so long renders can be scraped instead of watched. Enabled with -metrics-port.
+//
+// NOTE: the counters are written by the render threads with plain stores or interlocked
+// adds and read by the server thread without locks, a scrape is a snapshot that may be a
+// tile behind. The server thread only reads, so it doesn't take a profile/trace slot.
+
+#define METRICS_RESPONSE_SIZE (16*1024)
+// a client that stalls is dropped after this, so it can't hold up later scrapes or shutdown
+#define METRICS_SOCKET_TIMEOUT_MS 1000
+
+struct RenderMetrics
+{
+	volatile LONG tilesDone;
+	LONG tilesTotal; // tiles to render, not counting those restored from a checkpoint
+	LONG tilesRestored;
+	volatile LONG64 samplesDone;
+	uint64 workerBusyTime[MAX_RENDER_THREAD_COUNT]; // hires counts, each written only by its worker
+	uint64 workerFirstTileTime[MAX_RENDER_THREAD_COUNT]; // start of the first tile, 0 until the worker takes one
+	uint64 workerLastTileTime[MAX_RENDER_THREAD_COUNT]; // end of the last tile so far
+	LONG workerTiles[MAX_RENDER_THREAD_COUNT];
+	int workerCount;
+	uint64 renderStartTime; // hires counts, 0 until the render starts
+	uint64 renderEndTime; // 0 until the render finishes
+};
+
+struct MetricsServer
+{
+	SOCKET listenSocket;
+	HANDLE thread;
+};
+
+RenderMetrics gMetrics = {};
+
+// called by a worker after each tile, start and end in hires counts
+inline void RecordTileMetrics(int workerIndex, LONG64 sampleCount, uint64 start, uint64 end)
+{
+	if(!gMetrics.workerFirstTileTime[workerIndex])
+	{
+		gMetrics.workerFirstTileTime[workerIndex] = start;
+	}
+	gMetrics.workerLastTileTime[workerIndex] = end;
+	gMetrics.workerBusyTime[workerIndex] += end - start;
+	gMetrics.workerTiles[workerIndex]++;
+	InterlockedExchangeAdd64(&gMetrics.samplesDone, sampleCount);
+	InterlockedIncrement(&gMetrics.tilesDone);
+}
+
+void AppendMetric(char * buf, uint bufLength, uint * length, const char * name, const char * type, const char * help)
+{
+	ProfileAppend(buf, bufLength, length, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+uint FormatMetrics(char * buf, uint bufLength)
+{
+	uint length = 0;
+	uint64 now = GetHiresTime();
+	double elapsed = 0.0;
+	if(gMetrics.renderStartTime)
+	{
+		elapsed = (double)((gMetrics.renderEndTime ? gMetrics.renderEndTime : now) - gMetrics.renderStartTime) / countsPerSecond;
+	}
+
+	LONG tilesDone = gMetrics.tilesDone;
+	AppendMetric(buf, bufLength, &length, "rt_tiles_done_total", "counter", "Tiles rendered.");
+	ProfileAppend(buf, bufLength, &length, "rt_tiles_done_total %ld\n", tilesDone);
+	AppendMetric(buf, bufLength, &length, "rt_tiles", "gauge", "Tiles to render, not counting tiles restored from a checkpoint.");
+	ProfileAppend(buf, bufLength, &length, "rt_tiles %ld\n", gMetrics.tilesTotal);
+	AppendMetric(buf, bufLength, &length, "rt_tiles_restored", "gauge", "Tiles restored from a checkpoint.");
+	ProfileAppend(buf, bufLength, &length, "rt_tiles_restored %ld\n", gMetrics.tilesRestored);
+
+	LONG64 samplesDone = gMetrics.samplesDone;
+	AppendMetric(buf, bufLength, &length, "rt_samples_total", "counter", "Camera samples in finished tiles.");
+	ProfileAppend(buf, bufLength, &length, "rt_samples_total %lld\n", samplesDone);
+	AppendMetric(buf, bufLength, &length, "rt_samples_per_second", "gauge", "Average sample rate since the render started.");
+	ProfileAppend(buf, bufLength, &length, "rt_samples_per_second %.1f\n", elapsed > 0.0 ? samplesDone / elapsed : 0.0);
+
+	RayStats rays;
+	MergeRayStats(&rays);
+	AppendMetric(buf, bufLength, &length, "rt_rays_total", "counter", "Rays traced, by type.");
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		ProfileAppend(buf, bufLength, &length, "rt_rays_total{type=\"%s\"} %llu\n", rayTypeNames[i], rays.rays[i]);
+	}
+	AppendMetric(buf, bufLength, &length, "rt_rays_per_second", "gauge", "Average ray rate since the render started, by type.");
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		ProfileAppend(buf, bufLength, &length, "rt_rays_per_second{type=\"%s\"} %.1f\n", rayTypeNames[i], elapsed > 0.0 ? rays.rays[i] / elapsed : 0.0);
+	}
+
+	AppendMetric(buf, bufLength, &length, "rt_worker_busy_seconds_total", "counter", "Time each render thread spent rendering tiles.");
+	for(int i = 0; i < gMetrics.workerCount; ++i)
+	{
+		ProfileAppend(buf, bufLength, &length, "rt_worker_busy_seconds_total{worker=\"%d\"} %.3f\n", i, gMetrics.workerBusyTime[i] / countsPerSecond);
+	}
+	AppendMetric(buf, bufLength, &length, "rt_worker_utilization", "gauge", "Fraction of the render time each render thread was busy.");
+	for(int i = 0; i < gMetrics.workerCount; ++i)
+	{
+		double busy = gMetrics.workerBusyTime[i] / countsPerSecond;
+		ProfileAppend(buf, bufLength, &length, "rt_worker_utilization{worker=\"%d\"} %.4f\n", i, elapsed > 0.0 ? min(busy / elapsed, 1.0) : 0.0);
+	}
+
+	PROCESS_MEMORY_COUNTERS_EX memory = {};
+	memory.cb = sizeof(memory);
+	if(GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memory, sizeof(memory)))
+	{
+		AppendMetric(buf, bufLength, &length, "rt_memory_working_set_bytes", "gauge", "Physical memory in use by the process.");
+		ProfileAppend(buf, bufLength, &length, "rt_memory_working_set_bytes %llu\n", (uint64)memory.WorkingSetSize);
+		AppendMetric(buf, bufLength, &length, "rt_memory_private_bytes", "gauge", "Memory committed by the process.");
+		ProfileAppend(buf, bufLength, &length, "rt_memory_private_bytes %llu\n", (uint64)memory.PrivateUsage);
+	}
+
+#if MEMORY_TRACKING
+	AppendMetric(buf, bufLength, &length, "rt_memory_tracked_bytes", "gauge", "Tracked allocations currently live, by category.");
+	for(int i = 0; i < MEMORY_TAG_COUNT; ++i)
+	{
+		ProfileAppend(buf, bufLength, &length, "rt_memory_tracked_bytes{tag=\"%s\"} %lld\n", memoryTagNames[i], (long long)memoryStats[i].currentBytes);
+	}
+	AppendMetric(buf, bufLength, &length, "rt_memory_tracked_peak_bytes", "gauge", "Peak of the tracked allocations, by category.");
+	for(int i = 0; i < MEMORY_TAG_COUNT; ++i)
+	{
+		ProfileAppend(buf, bufLength, &length, "rt_memory_tracked_peak_bytes{tag=\"%s\"} %lld\n", memoryTagNames[i], (long long)memoryStats[i].peakBytes);
+	}
+#endif
+
+	// linear in tiles, tiles near the center tend to be the expensive ones and go last
+	double eta = 0.0;
+	if(tilesDone > 0 && !gMetrics.renderEndTime)
+	{
+		eta = elapsed * (gMetrics.tilesTotal - tilesDone) / tilesDone;
+	}
+	AppendMetric(buf, bufLength, &length, "rt_render_elapsed_seconds", "gauge", "Time since the render started.");
+	ProfileAppend(buf, bufLength, &length, "rt_render_elapsed_seconds %.3f\n", elapsed);
+	AppendMetric(buf, bufLength, &length, "rt_render_eta_seconds", "gauge", "Estimated time to finish, from the tile rate so far.");
+	ProfileAppend(buf, bufLength, &length, "rt_render_eta_seconds %.3f\n", eta);
+	AppendMetric(buf, bufLength, &length, "rt_render_finished", "gauge", "1 once every tile is done.");
+	ProfileAppend(buf, bufLength, &length, "rt_render_finished %d\n", gMetrics.renderEndTime ? 1 : 0);
+	return length;
+}
+
+bool SendAll(SOCKET s, const char * data, int size)
+{
+	while(size > 0)
+	{
+		int sent = send(s, data, size, 0);
+		if(sent == SOCKET_ERROR)
+		{
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+void ServeMetricsRequest(SOCKET client, char * body)
+{
+	char request[1024];
+	int received = recv(client, request, sizeof(request) - 1, 0);
+	if(received <= 0)
+	{
+		return;
+	}
+	request[received] = 0;
+
+	char header[256];
+	int headerLength;
+	if(strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0)
+	{
+		uint bodyLength = FormatMetrics(body, METRICS_RESPONSE_SIZE);
+		headerLength = _snprintf(header, sizeof(header),
+								 "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", bodyLength);
+		SendAll(client, header, headerLength);
+		SendAll(client, body, bodyLength);
+	}
+	else
+	{
+		headerLength = _snprintf(header, sizeof(header), "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		SendAll(client, header, headerLength);
+	}
+}
+
+DWORD WINAPI MetricsThreadFunc(LPVOID param)
+{
+	SOCKET listenSocket = ((MetricsServer*)param)->listenSocket;
+	char * body = TRACKED_NEW(MEMORY_INSTRUMENTATION, char, METRICS_RESPONSE_SIZE);
+	while(true)
+	{
+		// fails once StopMetricsServer closes the listening socket
+		SOCKET client = accept(listenSocket, NULL, NULL);
+		if(client == INVALID_SOCKET)
+		{
+			break;
+		}
+		DWORD timeout = METRICS_SOCKET_TIMEOUT_MS;
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+		ServeMetricsRequest(client, body);
+		shutdown(client, SD_SEND);
+		closesocket(client);
+	}
+	TRACKED_DELETE(MEMORY_INSTRUMENTATION, body, METRICS_RESPONSE_SIZE);
+	return 0;
+}
+
+// listens on 127.0.0.1 only
+bool StartMetricsServer(MetricsServer * server, int port)
+{
+	*server = {};
+	server->listenSocket = INVALID_SOCKET;
+
+	WSADATA wsaData;
+	if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		OutputDebugStringA("Failed to initialize Winsock!");
+		return false;
+	}
+
+	server->listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((u_short)port);
+	if(server->listenSocket == INVALID_SOCKET ||
+	   bind(server->listenSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+	   listen(server->listenSocket, SOMAXCONN) == SOCKET_ERROR)
+	{
+		OutputDebugStringA("Failed to open metrics port!");
+		if(server->listenSocket != INVALID_SOCKET)
+		{
+			closesocket(server->listenSocket);
+		}
+		WSACleanup();
+		*server = {};
+		return false;
+	}
+
+	server->thread = CreateThread(NULL, 0, MetricsThreadFunc, server, 0, NULL);
+	return true;
+}
+
+void StopMetricsServer(MetricsServer * server)
+{
+	if(server->thread)
+	{
+		closesocket(server->listenSocket);
+		// a request in flight times out on its own, at most one receive and one send
+		if(WaitForSingleObject(server->thread, 4 * METRICS_SOCKET_TIMEOUT_MS) == WAIT_OBJECT_0)
+		{
+			WSACleanup();
+		}
+		else
+		{
+			// leave Winsock up rather than pull it from under the thread
+			OutputDebugStringA("Metrics thread didn't stop!");
+		}
+		CloseHandle(server->thread);
+	}
+	*server = {};
+}
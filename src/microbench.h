@@ -0,0 +1,342 @@
+#pragma once
+
+// Microbenchmarks for the intersection and sampling kernels, run on the main thread
+// by rtbench -micro. Every kernel is called over pregenerated batches of rays,
+// primitives and samples, call i uses item order[i] of each. With hot data the batches
+// are small enough to stay in L1/L2, with cold data they are much bigger than the last
+// level cache. The order is a random permutation so the prefetcher can't follow it and
+// a cold call misses on its inputs.
+//
+// The Get*Samples* kernels read no inputs, they only write. For them hot and cold
+// differ just in where the output goes, a few lines in L1 or a random block of the
+// whole output buffer.
+//
+// NOTE: build with the default profile tier or -DPROFILE_LEVEL=0. At PROFILE_LEVEL_FINE
+// the kernels carry their own profile scopes and primitive counters, which is measured too.
+
+#define MICRO_HOT_COUNT (1<<10)
+#define MICRO_COLD_COUNT (1<<20)
+#define MICRO_MESH_TRIANGLES 16
+#define MICRO_SAMPLES_PER_CALL 64
+#define MICRO_REPEATS 5
+
+// batches of MICRO_COLD_COUNT, the hot runs use the first MICRO_HOT_COUNT of each
+struct MicroData
+{
+	Ray * rays;
+	Sphere * spheres;
+	Plane * planes;
+	AABB * boxes;
+	Mesh * meshes; // MICRO_COLD_COUNT / MICRO_MESH_TRIANGLES of them, so all the vertices fit the same budget
+	V3 * positions;
+	V3 * meshNormals;
+	uint16 * indices; // the same for every mesh
+	V3 * normals;
+	V3 * directions; // samples on the hemisphere around +Z
+	V2 * squares; // samples on [-1, 1]^2
+	V3 * output; // for the Get*Samples* functions
+	uint * hotOrder; // a permutation of [0, MICRO_HOT_COUNT)
+	uint * coldOrder; // a permutation of [0, MICRO_COLD_COUNT)
+};
+
+typedef uint64 (*MicroKernel)(MicroData * data, uint64 calls, const uint * order, uint mask);
+
+struct MicroBenchmark
+{
+	const char * name;
+	MicroKernel kernel;
+	uint64 calls;
+	uint itemsPerCall; // primitives tested or samples generated per call
+};
+
+// results are summed into this so the calls can't be optimized away
+volatile uint64 microSink;
+
+void ShuffleOrder(uint * order, uint count, RNG * rng)
+{
+	for(uint i = 0; i < count; ++i)
+	{
+		order[i] = i;
+	}
+	for(uint i = count - 1; i > 0; --i)
+	{
+		uint j = rng->generator() % (i + 1);
+		uint t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+void InitMicroData(MicroData * data, uint32 seed)
+{
+	const uint count = MICRO_COLD_COUNT;
+	const uint meshCount = MICRO_COLD_COUNT / MICRO_MESH_TRIANGLES;
+	RNG rng(seed);
+
+	data->rays = TRACKED_NEW(MEMORY_SCRATCH, Ray, count);
+	data->spheres = TRACKED_NEW(MEMORY_SCRATCH, Sphere, count);
+	data->planes = TRACKED_NEW(MEMORY_SCRATCH, Plane, count);
+	data->boxes = TRACKED_NEW(MEMORY_SCRATCH, AABB, count);
+	data->meshes = TRACKED_NEW(MEMORY_SCRATCH, Mesh, meshCount);
+	data->positions = TRACKED_NEW(MEMORY_SCRATCH, V3, meshCount * MICRO_MESH_TRIANGLES * 3);
+	data->meshNormals = TRACKED_NEW(MEMORY_SCRATCH, V3, meshCount * MICRO_MESH_TRIANGLES * 3);
+	data->indices = TRACKED_NEW(MEMORY_SCRATCH, uint16, MICRO_MESH_TRIANGLES * 3);
+	data->normals = TRACKED_NEW(MEMORY_SCRATCH, V3, count);
+	data->directions = TRACKED_NEW(MEMORY_SCRATCH, V3, count);
+	data->squares = TRACKED_NEW(MEMORY_SCRATCH, V2, count);
+	data->output = TRACKED_NEW(MEMORY_SCRATCH, V3, count);
+	data->hotOrder = TRACKED_NEW(MEMORY_SCRATCH, uint, MICRO_HOT_COUNT);
+	data->coldOrder = TRACKED_NEW(MEMORY_SCRATCH, uint, count);
+	ShuffleOrder(data->hotOrder, MICRO_HOT_COUNT, &rng);
+	ShuffleOrder(data->coldOrder, count, &rng);
+
+	// primitives around the origin, rays from a shell around them aimed close to the center,
+	// so roughly half of the tests hit
+	for(uint i = 0; i < count; ++i)
+	{
+		V3 target = {rng.Next(-1.5f, 1.5f), rng.Next(-1.5f, 1.5f), rng.Next(-1.5f, 1.5f)};
+		V3 origin = RandomUnitVector(&rng) * 5.0f;
+		data->rays[i] = {origin, Normalize(target - origin)};
+
+		data->spheres[i] = {V3{rng.Next(-0.5f, 0.5f), rng.Next(-0.5f, 0.5f), rng.Next(-0.5f, 0.5f)}, rng.Next(0.5f, 1.5f)};
+		data->planes[i] = {V3{rng.Next(-0.5f, 0.5f), rng.Next(-0.5f, 0.5f), rng.Next(-0.5f, 0.5f)}, RandomUnitVector(&rng)};
+		V3 center = {rng.Next(-0.5f, 0.5f), rng.Next(-0.5f, 0.5f), rng.Next(-0.5f, 0.5f)};
+		V3 extent = {rng.Next(0.2f, 1.2f), rng.Next(0.2f, 1.2f), rng.Next(0.2f, 1.2f)};
+		data->boxes[i] = {center - extent, center + extent};
+
+		data->normals[i] = RandomUnitVector(&rng);
+		V3 direction = RandomUnitVector(&rng);
+		direction.z = fabsf(direction.z);
+		data->directions[i] = direction;
+		data->squares[i] = {rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f)};
+	}
+
+	// small triangle soups in a unit box
+	for(uint i = 0; i < MICRO_MESH_TRIANGLES * 3; ++i)
+	{
+		data->indices[i] = (uint16)i;
+	}
+	for(uint m = 0; m < meshCount; ++m)
+	{
+		Mesh * mesh = &data->meshes[m];
+		*mesh = {};
+		mesh->vertexCount = MICRO_MESH_TRIANGLES * 3;
+		mesh->triangleCount = MICRO_MESH_TRIANGLES;
+		mesh->positions = data->positions + m * MICRO_MESH_TRIANGLES * 3;
+		mesh->normals = data->meshNormals + m * MICRO_MESH_TRIANGLES * 3;
+		mesh->indices = data->indices;
+		mesh->shortIndices = true;
+		for(uint i = 0; i < mesh->vertexCount; i += 3)
+		{
+			V3 p0 = {rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f)};
+			V3 p1 = p0 + V3{rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f)};
+			V3 p2 = p0 + V3{rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f), rng.Next(-1.0f, 1.0f)};
+			V3 n = Normalize(Cross(p1 - p0, p2 - p0));
+			mesh->positions[i + 0] = p0;
+			mesh->positions[i + 1] = p1;
+			mesh->positions[i + 2] = p2;
+			SetMeshNormal(mesh, i + 0, n);
+			SetMeshNormal(mesh, i + 1, n);
+			SetMeshNormal(mesh, i + 2, n);
+		}
+		ComputeMeshBound(mesh);
+	}
+}
+
+void FreeMicroData(MicroData * data)
+{
+	const uint count = MICRO_COLD_COUNT;
+	const uint meshCount = MICRO_COLD_COUNT / MICRO_MESH_TRIANGLES;
+	TRACKED_DELETE(MEMORY_SCRATCH, data->rays, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->spheres, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->planes, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->boxes, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->meshes, meshCount);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->positions, meshCount * MICRO_MESH_TRIANGLES * 3);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->meshNormals, meshCount * MICRO_MESH_TRIANGLES * 3);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->indices, MICRO_MESH_TRIANGLES * 3);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->normals, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->directions, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->squares, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->output, count);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->hotOrder, MICRO_HOT_COUNT);
+	TRACKED_DELETE(MEMORY_SCRATCH, data->coldOrder, count);
+	*data = {};
+}
+
+/* Kernels */
+
+uint64 MicroIntersectRaySphere(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	uint64 hits = 0;
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint j = order[i & mask];
+		Intersection ix;
+		hits += IntersectRaySphere(data->rays[j], data->spheres[j], &ix);
+	}
+	return hits;
+}
+
+uint64 MicroIntersectRayPlane(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	uint64 hits = 0;
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint j = order[i & mask];
+		Intersection ix;
+		hits += IntersectRayPlane(data->rays[j], data->planes[j], &ix);
+	}
+	return hits;
+}
+
+uint64 MicroIntersectRayMesh(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	uint64 hits = 0;
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint j = order[i & mask];
+		Intersection ix;
+		ix.t = FLOAT_MAX;
+		hits += IntersectRayMesh(data->rays[j], &data->meshes[j / MICRO_MESH_TRIANGLES], &ix);
+	}
+	return hits;
+}
+
+uint64 MicroTestRayAABB(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	uint64 hits = 0;
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint j = order[i & mask];
+		hits += TestRayAABB(data->rays[j], data->boxes[j]);
+	}
+	return hits;
+}
+
+uint64 MicroRotateSample(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	float sum = 0.0f;
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint j = order[i & mask];
+		sum += RotateSample(data->directions[j], data->normals[j]).z;
+	}
+	return (uint64)sum;
+}
+
+uint64 MicroShirley(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	float sum = 0.0f;
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint j = order[i & mask];
+		sum += Shirley(data->squares[j]).x;
+	}
+	return (uint64)sum;
+}
+
+// each call writes MICRO_SAMPLES_PER_CALL samples to a block of the output picked by the order
+#define MICRO_SAMPLE_KERNEL(function)														\
+	uint64 Micro##function(MicroData * data, uint64 calls, const uint * order, uint mask)						\
+	{																						\
+		uint64 total = 0;																	\
+		for(uint64 i = 0; i < calls; ++i)													\
+		{																					\
+			uint offset = order[i & mask] & ~(MICRO_SAMPLES_PER_CALL - 1); \
+			total += function(MICRO_SAMPLES_PER_CALL, data->output + offset);				\
+		}																					\
+		return total;																		\
+	}
+
+MICRO_SAMPLE_KERNEL(GetRandomSamplesInUnitCube)
+MICRO_SAMPLE_KERNEL(GetRandomSamplesOnHemisphere)
+MICRO_SAMPLE_KERNEL(GetRandomSamplesOnDisk)
+MICRO_SAMPLE_KERNEL(GetUniformSamplesOnSquare)
+MICRO_SAMPLE_KERNEL(GetUniformSamplesOnDisk)
+MICRO_SAMPLE_KERNEL(GetUniformSamplesOnHemisphere)
+MICRO_SAMPLE_KERNEL(GetJitteredSamplesOnSquare)
+MICRO_SAMPLE_KERNEL(GetJitteredSamplesOnDisk)
+MICRO_SAMPLE_KERNEL(GetJitteredSamplesOnHemisphere)
+
+// GetRandomSamplesOnUnitCubeSurface returns nothing
+uint64 MicroGetRandomSamplesOnUnitCubeSurface(MicroData * data, uint64 calls, const uint * order, uint mask)
+{
+	for(uint64 i = 0; i < calls; ++i)
+	{
+		uint offset = order[i & mask] & ~(MICRO_SAMPLES_PER_CALL - 1);
+		GetRandomSamplesOnUnitCubeSurface(MICRO_SAMPLES_PER_CALL, data->output + offset);
+	}
+	return calls;
+}
+
+#define MICRO_BENCHMARK(function, calls, items) {#function, Micro##function, calls, items}
+
+MicroBenchmark microBenchmarks[] = {
+	MICRO_BENCHMARK(IntersectRaySphere, 1<<24, 1),
+	MICRO_BENCHMARK(IntersectRayPlane, 1<<24, 1),
+	MICRO_BENCHMARK(IntersectRayMesh, 1<<20, MICRO_MESH_TRIANGLES),
+	MICRO_BENCHMARK(TestRayAABB, 1<<24, 1),
+	MICRO_BENCHMARK(RotateSample, 1<<22, 1),
+	MICRO_BENCHMARK(Shirley, 1<<24, 1),
+	MICRO_BENCHMARK(GetRandomSamplesOnUnitCubeSurface, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetRandomSamplesInUnitCube, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetRandomSamplesOnHemisphere, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetRandomSamplesOnDisk, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetUniformSamplesOnSquare, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetUniformSamplesOnDisk, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetUniformSamplesOnHemisphere, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetJitteredSamplesOnSquare, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetJitteredSamplesOnDisk, 1<<16, MICRO_SAMPLES_PER_CALL),
+	MICRO_BENCHMARK(GetJitteredSamplesOnHemisphere, 1<<16, MICRO_SAMPLES_PER_CALL),
+};
+
+// best of MICRO_REPEATS, in seconds
+double RunMicroBenchmark(MicroBenchmark * bench, MicroData * data, bool hot)
+{
+	uint mask = (hot ? MICRO_HOT_COUNT : MICRO_COLD_COUNT) - 1;
+	const uint * order = hot ? data->hotOrder : data->coldOrder;
+	double best = 0.0;
+	for(int r = 0; r < MICRO_REPEATS; ++r)
+	{
+		uint64 start = GetHiresTime();
+		microSink += bench->kernel(data, bench->calls, order, mask);
+		double seconds = (GetHiresTime() - start) / countsPerSecond;
+		if(r == 0 || seconds < best)
+		{
+			best = seconds;
+		}
+	}
+	return best;
+}
+
+// kernelName null runs all of them
+void RunMicroBenchmarks(FILE * file, const char * kernelName)
+{
+	MicroData data;
+	InitMicroData(&data, BENCH_SEED);
+
+	fprintf(file, "\"kernels\": [\n");
+	bool first = true;
+	for(int i = 0; i < sizeof(microBenchmarks)/sizeof(microBenchmarks[0]); ++i)
+	{
+		MicroBenchmark * bench = &microBenchmarks[i];
+		if(kernelName && strcmp(kernelName, bench->name) != 0)
+		{
+			continue;
+		}
+		for(int hot = 1; hot >= 0; --hot)
+		{
+			double seconds = RunMicroBenchmark(bench, &data, hot != 0);
+			double nsPerCall = seconds * 1000000000.0 / bench->calls;
+			fprintf(file, "%s    {\"name\": \"%s\", \"data\": \"%s\", \"calls\": %llu, \"itemsPerCall\": %u, \"nsPerCall\": %.3f, \"nsPerItem\": %.3f, \"callsPerSecond\": %.0f}",
+					first ? "" : ",\n", bench->name, hot ? "hot" : "cold", bench->calls, bench->itemsPerCall,
+					nsPerCall, nsPerCall / bench->itemsPerCall, seconds > 0.0 ? bench->calls / seconds : 0.0);
+			fprintf(stderr, "%-34s %-4s %10.3f ns/call\n", bench->name, hot ? "hot" : "cold", nsPerCall);
+			first = false;
+		}
+	}
+	fprintf(file, "\n]");
+
+	FreeMicroData(&data);
+}
@@ -1,11 +1,44 @@
 #include <cstdio>
+#include <stdarg.h>
+
+// Instrumentation tiers:
+//   off    - no profiled scopes at all
+//   coarse - PROFILED_FUNCTION / PROFILED_BLOCK scopes (tiles, I/O), can be switched off
+//            at runtime, see gProfileEnabled
+//   fine   - also the _FAST scopes in per-ray and per-primitive code
+// build.bat --profile selects fine, the default build is coarse. Anything else can be
+// forced with -DPROFILE_LEVEL=n.
+#define PROFILE_LEVEL_OFF 0
+#define PROFILE_LEVEL_COARSE 1
+#define PROFILE_LEVEL_FINE 2
+
+#ifndef PROFILE_LEVEL
+#ifdef _PROFILE_
+#define PROFILE_LEVEL PROFILE_LEVEL_FINE
+#else
+#define PROFILE_LEVEL PROFILE_LEVEL_COARSE
+#endif
+#endif
 
+#if PROFILE_LEVEL > PROFILE_LEVEL_OFF
 #define PROFILE 1
+#endif
 
 #define PROFILE_NAME_MAX_LENGTH 64
 #define MAX_PROFILE_RECORDS 1024
 #define PROFILE_PER_THREAD_OUTPUT 0
-
+// call tree of profiled scopes per thread, replaces the flat table in PrintProfile
+#define PROFILE_HIERARCHY 1
+#define MAX_PROFILE_NODES 1024
+// allocation tracking by category, compiled out of release builds
+#if defined(_DEBUG_) || defined(_PROFILE_)
+#define MEMORY_TRACKING 1
+#else
+#define MEMORY_TRACKING 0
+#endif
+// latency histogram per scope, only kept for the first MAX_PROFILE_HISTOGRAMS records
+#define PROFILE_HISTOGRAMS 1
+#define MAX_PROFILE_HISTOGRAMS 32
 
 double countsPerSecond;
 double countsPerMs;
@@ -27,16 +60,146 @@ struct ProfileRecord
 	uint64 cyclesTotal;
 };
 
+// One node per distinct call path. Node 0 is the root, so 0 doubles as "no node"
+// for firstChild and nextSibling.
+struct ProfileNode
+{
+	uint recordIndex;
+	int parent;
+	int firstChild;
+	int nextSibling;
+	uint64 callCount;
+	uint64 inclusiveCycles;
+	uint64 childCycles;
+};
+
+struct ProfileTree
+{
+	ProfileNode nodes[MAX_PROFILE_NODES];
+	int nodeCount;
+	int currentNode;
+};
+
+// NOTE: log-linear buckets in cycles, like HdrHistogram: every power of two is split into
+// 1 << PROFILE_HISTOGRAM_SUB_BITS buckets, so a bucket is at most 12.5% wide. Values below
+// the first split get a bucket each.
+#define PROFILE_HISTOGRAM_SUB_BITS 3
+#define PROFILE_HISTOGRAM_SUB_BUCKETS (1 << PROFILE_HISTOGRAM_SUB_BITS)
+#define PROFILE_HISTOGRAM_BUCKETS ((64 - PROFILE_HISTOGRAM_SUB_BITS + 1) * PROFILE_HISTOGRAM_SUB_BUCKETS)
+
+struct ProfileHistogram
+{
+	uint64 buckets[PROFILE_HISTOGRAM_BUCKETS];
+	uint64 maxCycles;
+};
+
+#define CACHE_LINE_SIZE 64
+
+// NOTE: each thread writes only to its own cache line aligned block, so profiled scopes
+// don't bounce lines between cores. Blocks are merged when the profile is printed.
+struct __declspec(align(CACHE_LINE_SIZE)) ProfileThreadBlock
+{
+	ProfileRecord records[MAX_PROFILE_RECORDS];
+#if PROFILE_HIERARCHY
+	ProfileTree tree;
+#endif
+#if PROFILE_HISTOGRAMS
+	ProfileHistogram histograms[MAX_PROFILE_HISTOGRAMS];
+#endif
+};
+
 struct Profile
 {
-	ProfileRecord records[MAX_PROFILE_RECORDS][PROGRAM_THREAD_COUNT];
+	ProfileThreadBlock threads[PROGRAM_THREAD_COUNT];
 	inline ProfileRecord & operator[](int index)
 	{
-		return records[index][LOCAL_THREAD_ID];
+		return threads[LOCAL_THREAD_ID].records[index];
 	}
 };
 
 Profile profile = {};
+bool gProfileEnabled = true;
+
+/* Memory */
+
+enum MemoryTag
+{
+	MEMORY_GEOMETRY,
+	MEMORY_ACCELERATION,
+	MEMORY_FRAMEBUFFER,
+	MEMORY_MAPPED_FRAMEBUFFER, // address space only, the file backs it
+	MEMORY_SCRATCH, // per-thread, per-tile buffers
+	MEMORY_IO,
+	MEMORY_INSTRUMENTATION,
+	MEMORY_OTHER,
+	MEMORY_TAG_COUNT
+};
+
+const char * memoryTagNames[MEMORY_TAG_COUNT] = {
+	"Geometry", "Acceleration", "Framebuffer", "Mapped framebuffer", "Scratch", "I/O", "Instrumentation", "Other"
+};
+
+struct MemoryTagStats
+{
+	volatile LONG64 currentBytes;
+	volatile LONG64 peakBytes;
+	volatile LONG64 allocationCount; // live ones
+};
+
+MemoryTagStats memoryStats[MEMORY_TAG_COUNT + 1]; // the last one is the total
+
+inline void UpdatePeakBytes(volatile LONG64 * peak, LONG64 current)
+{
+	LONG64 previous = *peak;
+	while(current > previous)
+	{
+		LONG64 seen = InterlockedCompareExchange64(peak, current, previous);
+		if(seen == previous)
+		{
+			break;
+		}
+		previous = seen;
+	}
+}
+
+// allocations is 0 when an existing allocation grows, like an arena committing more pages
+void TrackAllocation_(MemoryTag tag, size_t bytes, LONG64 allocations)
+{
+	MemoryTagStats * stats[2] = {&memoryStats[tag], &memoryStats[MEMORY_TAG_COUNT]};
+	for(int i = 0; i < 2; ++i)
+	{
+		LONG64 current = InterlockedExchangeAdd64(&stats[i]->currentBytes, (LONG64)bytes) + (LONG64)bytes;
+		UpdatePeakBytes(&stats[i]->peakBytes, current);
+		InterlockedExchangeAdd64(&stats[i]->allocationCount, allocations);
+	}
+}
+
+void TrackFree_(MemoryTag tag, size_t bytes)
+{
+	MemoryTagStats * stats[2] = {&memoryStats[tag], &memoryStats[MEMORY_TAG_COUNT]};
+	for(int i = 0; i < 2; ++i)
+	{
+		InterlockedExchangeAdd64(&stats[i]->currentBytes, -(LONG64)bytes);
+		InterlockedDecrement64(&stats[i]->allocationCount);
+	}
+}
+
+// Only heap and VirtualAlloc memory is tracked, statics are in the image already.
+// NOTE: the array forms need the element count again when freeing, there is no header
+// in front of the allocation to keep it in
+#if MEMORY_TRACKING
+	#define TRACK_ALLOC(tag, bytes) TrackAllocation_(tag, bytes, 1)
+	#define TRACK_GROW(tag, bytes) TrackAllocation_(tag, bytes, 0)
+	#define TRACK_FREE(tag, bytes) TrackFree_(tag, bytes)
+#else
+	#define TRACK_ALLOC(tag, bytes) ((void)0)
+	#define TRACK_GROW(tag, bytes) ((void)0)
+	#define TRACK_FREE(tag, bytes) ((void)0)
+#endif
+#define TRACKED_NEW(tag, type, count) (TRACK_ALLOC(tag, sizeof(type) * (count)), new type[count])
+#define TRACKED_DELETE(tag, ptr, count) (TRACK_FREE(tag, sizeof(*(ptr)) * (count)), delete[] (ptr))
+
+/* Timing */
 
 void InitProfiler_()
 {
@@ -58,43 +221,192 @@ inline uint64 GetCycles()
 	return __rdtsc();
 }
 
+// Finds or creates the child of the current node for this scope and makes it current.
+// Returns -1 when the tree is full, the scope is then only counted in the flat records.
+inline int ProfileEnterNode(ProfileTree * tree, uint recordIndex)
+{
+	if(tree->nodeCount == 0)
+	{
+		tree->nodeCount = 1;
+	}
+
+	ProfileNode * parent = &tree->nodes[tree->currentNode];
+	int child = parent->firstChild;
+	while(child && tree->nodes[child].recordIndex != recordIndex)
+	{
+		child = tree->nodes[child].nextSibling;
+	}
+
+	if(!child)
+	{
+		if(tree->nodeCount == MAX_PROFILE_NODES)
+		{
+			return -1;
+		}
+		child = tree->nodeCount;
+		ProfileNode * node = &tree->nodes[child];
+		node->recordIndex = recordIndex;
+		node->parent = tree->currentNode;
+		node->nextSibling = parent->firstChild;
+		parent->firstChild = child;
+		tree->nodeCount++;
+	}
+
+	tree->currentNode = child;
+	return child;
+}
+
+inline void ProfileExitNode(ProfileTree * tree, int nodeIndex, uint64 cycles)
+{
+	if(nodeIndex < 0)
+	{
+		return;
+	}
+	ProfileNode * node = &tree->nodes[nodeIndex];
+	node->callCount++;
+	node->inclusiveCycles += cycles;
+	tree->nodes[node->parent].childCycles += cycles;
+	tree->currentNode = node->parent;
+}
+
+
+
+inline int ProfileEnterLocalNode(uint recordIndex)
+{
+#if PROFILE_HIERARCHY
+	return ProfileEnterNode(&profile.threads[LOCAL_THREAD_ID].tree, recordIndex);
+#else
+	return -1;
+#endif
+}
+
+inline void ProfileExitLocalNode(int nodeIndex, uint64 cycles)
+{
+#if PROFILE_HIERARCHY
+	ProfileExitNode(&profile.threads[LOCAL_THREAD_ID].tree, nodeIndex, cycles);
+#endif
+}
+
+inline uint GetProfileHistogramBucket(uint64 cycles)
+{
+	if(cycles < PROFILE_HISTOGRAM_SUB_BUCKETS)
+	{
+		return (uint)cycles;
+	}
+	unsigned long msb;
+	_BitScanReverse64(&msb, cycles);
+	uint shift = msb - PROFILE_HISTOGRAM_SUB_BITS;
+	return (shift + 1) * PROFILE_HISTOGRAM_SUB_BUCKETS + (uint)((cycles >> shift) & (PROFILE_HISTOGRAM_SUB_BUCKETS - 1));
+}
 
+// midpoint of the range of cycle counts that land in the bucket
+inline uint64 GetProfileHistogramValue(uint bucket)
+{
+	if(bucket < PROFILE_HISTOGRAM_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+	uint shift = bucket / PROFILE_HISTOGRAM_SUB_BUCKETS - 1;
+	uint64 low = (uint64)(PROFILE_HISTOGRAM_SUB_BUCKETS + bucket % PROFILE_HISTOGRAM_SUB_BUCKETS) << shift;
+	return low + ((1ull << shift) >> 1);
+}
+
+inline ProfileHistogram * GetLocalProfileHistogram(uint recordIndex)
+{
+#if PROFILE_HISTOGRAMS
+	if(recordIndex < MAX_PROFILE_HISTOGRAMS)
+	{
+		return &profile.threads[LOCAL_THREAD_ID].histograms[recordIndex];
+	}
+#endif
+	return nullptr;
+}
+
+inline void RecordProfileLatency(ProfileHistogram * histogram, uint64 cycles)
+{
+	if(histogram)
+	{
+		histogram->buckets[GetProfileHistogramBucket(cycles)]++;
+		if(cycles > histogram->maxCycles)
+		{
+			histogram->maxCycles = cycles;
+		}
+	}
+}
 
 struct ProfileProxyFast
 {
 	ProfileProxyFast(uint i, char * name)
 	{
-		index = i;
-		startCycles = GetCycles();
-		if(profile[index].callCount == 0)
+		if(!gProfileEnabled)
 		{
-			profile[index] = {};
-			profile[index].callCount++;
-			strncpy(profile[index].name, name, PROFILE_NAME_MAX_LENGTH);
+			record = nullptr;
+			return;
 		}
+		ProfileThreadBlock * block = &profile.threads[LOCAL_THREAD_ID];
+		record = &block->records[i];
+		if(record->callCount == 0)
+		{
+			*record = {};
+			record->callCount++;
+			strncpy(record->name, name, PROFILE_NAME_MAX_LENGTH);
+		}
+#if PROFILE_HIERARCHY
+		tree = &block->tree;
+		node = ProfileEnterNode(tree, i);
+#endif
+#if PROFILE_HISTOGRAMS
+		histogram = i < MAX_PROFILE_HISTOGRAMS ? &block->histograms[i] : nullptr;
+#endif
+		startCycles = GetCycles();
 	}
 
 	~ProfileProxyFast()
 	{
-		profile[index].cyclesTotal += GetCycles() - startCycles;
-		// uint64 y = GetCycles() - startCycles;
-		profile[index].callCount++;
+		if(!record)
+		{
+			return;
+		}
+		uint64 cycles = GetCycles() - startCycles;
+		record->cyclesTotal += cycles;
+		record->callCount++;
+#if PROFILE_HIERARCHY
+		ProfileExitNode(tree, node, cycles);
+#endif
+#if PROFILE_HISTOGRAMS
+		RecordProfileLatency(histogram, cycles);
+#endif
 	}
 
 
-	uint index;
+	ProfileRecord * record;
 	uint64 startCycles;
+#if PROFILE_HIERARCHY
+	ProfileTree * tree;
+	int node;
+#endif
+#if PROFILE_HISTOGRAMS
+	ProfileHistogram * histogram;
+#endif
 };
 
 struct ProfileProxy : public ProfileProxyFast
 {
 	ProfileProxy(uint i, char * name) : ProfileProxyFast(i, name)
 	{
+		if(!record)
+		{
+			return;
+		}
 		startTime = GetHiresTime();
 	}
 	~ProfileProxy()
 	{
-		profile[index].timeTotal += GetHiresTime() - startTime;
+		if(!record)
+		{
+			return;
+		}
+		record->timeTotal += GetHiresTime() - startTime;
 	}
 
 	uint64 startTime;
@@ -102,6 +414,58 @@ struct ProfileProxy : public ProfileProxyFast
 
 
 
+// NOTE: _snprintf returns -1 and writes no terminator when it truncates, don't let that walk
+// the length backwards. The last byte is kept for the terminator, so buf is always a string.
+void ProfileAppend(char * buf, uint bufLength, uint * length, const char * format, ...)
+{
+	if(bufLength == 0)
+	{
+		return;
+	}
+	if(*length + 1 >= bufLength)
+	{
+		*length = bufLength - 1;
+		buf[*length] = 0;
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	int written = _vsnprintf(buf + *length, bufLength - 1 - *length, format, args);
+	va_end(args);
+	*length = (written < 0 || *length + written > bufLength - 1) ? bufLength - 1 : *length + written;
+	buf[*length] = 0;
+}
+
+#if MEMORY_TRACKING
+void PrintMemoryStats(char * buf, uint bufLength, uint * length)
+{
+	ProfileAppend(buf, bufLength, length, "\nMemory\t\t\tCurrent\t\tPeak\t\tAllocations\n");
+	for(int i = 0; i <= MEMORY_TAG_COUNT; ++i)
+	{
+		MemoryTagStats * stats = &memoryStats[i];
+		if(stats->peakBytes == 0)
+		{
+			continue;
+		}
+		ProfileAppend(buf, bufLength, length, "%-20s\t%8.2fMB\t%8.2fMB\t%llu\n", i < MEMORY_TAG_COUNT ? memoryTagNames[i] : "Total",
+					  stats->currentBytes / (1024.0 * 1024.0), stats->peakBytes / (1024.0 * 1024.0), (uint64)stats->allocationCount);
+	}
+}
+
+void WriteMemoryStatsJSON(FILE * file)
+{
+	fprintf(file, ", \"memory\": [");
+	for(int i = 0; i <= MEMORY_TAG_COUNT; ++i)
+	{
+		MemoryTagStats * stats = &memoryStats[i];
+		fprintf(file, "%s\n  {\"tag\": \"%s\", \"currentBytes\": %lld, \"peakBytes\": %lld, \"allocations\": %lld}",
+				i ? "," : "", i < MEMORY_TAG_COUNT ? memoryTagNames[i] : "Total",
+				(long long)stats->currentBytes, (long long)stats->peakBytes, (long long)stats->allocationCount);
+	}
+	fprintf(file, "]");
+}
+#endif
+
 int PrintProfile_(char * buf, uint bufLength)
 {
 	uint length = 0;
@@ -124,9 +488,9 @@ int PrintProfile_(char * buf, uint bufLength)
 		for(int t = 0; t < gThreadCounter; ++t)
 		{
 
-			if(profile.records[i][t].callCount)
+			if(profile.threads[t].records[i].callCount)
 			{
-				ProfileRecord r = profile.records[i][t];
+				ProfileRecord r = profile.threads[t].records[i];
 				totalCallCount += r.callCount;
 
 #if PROFILE_PER_THREAD_OUTPUT
@@ -216,44 +580,310 @@ int PrintProfile_(char * buf, uint bufLength)
 #endif
 		}
 	}
+#if MEMORY_TRACKING
+	PrintMemoryStats(buf, bufLength, &length);
+#endif
+	return length;
+}
+
+
+#if PROFILE_HIERARCHY
+
+ProfileTree mergedProfileTree;
+
+char * GetProfileName(uint recordIndex)
+{
+	for(int t = 0; t < gThreadCounter; ++t)
+	{
+		if(profile.threads[t].records[recordIndex].callCount)
+		{
+			return profile.threads[t].records[recordIndex].name;
+		}
+	}
+	return "?";
+}
+
+void MergeProfileNode(ProfileTree * merged, int dst, ProfileTree * src, int srcNode)
+{
+	for(int c = src->nodes[srcNode].firstChild; c; c = src->nodes[c].nextSibling)
+	{
+		ProfileNode * s = &src->nodes[c];
+		int d = merged->nodes[dst].firstChild;
+		while(d && merged->nodes[d].recordIndex != s->recordIndex)
+		{
+			d = merged->nodes[d].nextSibling;
+		}
+		if(!d)
+		{
+			if(merged->nodeCount == MAX_PROFILE_NODES)
+			{
+				continue;
+			}
+			d = merged->nodeCount++;
+			merged->nodes[d] = {};
+			merged->nodes[d].recordIndex = s->recordIndex;
+			merged->nodes[d].parent = dst;
+			merged->nodes[d].nextSibling = merged->nodes[dst].firstChild;
+			merged->nodes[dst].firstChild = d;
+		}
+		merged->nodes[d].callCount += s->callCount;
+		merged->nodes[d].inclusiveCycles += s->inclusiveCycles;
+		merged->nodes[d].childCycles += s->childCycles;
+		MergeProfileNode(merged, d, src, c);
+	}
+}
+
+// merges the call trees of all threads by call path
+ProfileTree * MergeProfileTrees()
+{
+	ProfileTree * merged = &mergedProfileTree;
+	merged->nodes[0] = {};
+	merged->nodeCount = 1;
+	for(int t = 0; t < gThreadCounter; ++t)
+	{
+		ProfileTree * tree = &profile.threads[t].tree;
+		if(tree->nodeCount)
+		{
+			MergeProfileNode(merged, 0, tree, 0);
+		}
+	}
+
+	ProfileNode * root = &merged->nodes[0];
+	for(int c = root->firstChild; c; c = merged->nodes[c].nextSibling)
+	{
+		root->inclusiveCycles += merged->nodes[c].inclusiveCycles;
+	}
+	root->childCycles = root->inclusiveCycles;
+	return merged;
+}
+
+void PrintProfileNode(ProfileTree * tree, int nodeIndex, int depth, uint64 totalCycles, char * buf, uint bufLength, uint * length)
+{
+	ProfileNode * node = &tree->nodes[nodeIndex];
+	uint64 selfCycles = node->inclusiveCycles - node->childCycles;
+	double percent = totalCycles ? 100.0 * node->inclusiveCycles / totalCycles : 0.0;
+	ProfileAppend(buf, bufLength, length, "%*s%-*s\t", depth*2, "", 32 - depth*2, GetProfileName(node->recordIndex));
+	if(node->callCount >= 1000000)
+	{
+		ProfileAppend(buf, bufLength, length, "CC: %6.2fM\t", node->callCount / 1000000.0);
+	}
+	else
+	{
+		ProfileAppend(buf, bufLength, length, "CC: %6llu \t", node->callCount);
+	}
+	ProfileAppend(buf, bufLength, length, "IN: %8.1fM\tSF: %8.1fM\t%5.1f%%\n", node->inclusiveCycles / 1000000.0, selfCycles / 1000000.0, percent);
+
+	for(int c = node->firstChild; c; c = tree->nodes[c].nextSibling)
+	{
+		PrintProfileNode(tree, c, depth + 1, totalCycles, buf, bufLength, length);
+	}
+}
+
+#if PROFILE_HISTOGRAMS
+ProfileHistogram mergedProfileHistogram;
+
+// sums a record's histogram over all threads, returns the number of samples
+uint64 MergeProfileHistograms(uint recordIndex, ProfileHistogram * merged)
+{
+	uint64 count = 0;
+	*merged = {};
+	for(int t = 0; t < gThreadCounter; ++t)
+	{
+		ProfileHistogram * histogram = &profile.threads[t].histograms[recordIndex];
+		for(int b = 0; b < PROFILE_HISTOGRAM_BUCKETS; ++b)
+		{
+			merged->buckets[b] += histogram->buckets[b];
+			count += histogram->buckets[b];
+		}
+		merged->maxCycles = max(merged->maxCycles, histogram->maxCycles);
+	}
+	return count;
+}
+
+uint64 GetProfilePercentile(ProfileHistogram * histogram, uint64 count, double percentile)
+{
+	uint64 target = (uint64)ceil(count * percentile / 100.0);
+	uint64 seen = 0;
+	for(uint b = 0; b < PROFILE_HISTOGRAM_BUCKETS; ++b)
+	{
+		seen += histogram->buckets[b];
+		if(seen >= target && seen > 0)
+		{
+			// a bucket midpoint can overshoot the largest sample
+			return min(GetProfileHistogramValue(b), histogram->maxCycles);
+		}
+	}
+	return histogram->maxCycles;
+}
+
+void PrintProfileHistograms(char * buf, uint bufLength, uint * length)
+{
+	ProfileAppend(buf, bufLength, length, "\nLatency in rdtsc per call\n\n");
+	for(uint i = 0; i < MAX_PROFILE_HISTOGRAMS; ++i)
+	{
+		ProfileHistogram * histogram = &mergedProfileHistogram;
+		uint64 count = MergeProfileHistograms(i, histogram);
+		if(count == 0)
+		{
+			continue;
+		}
+		ProfileAppend(buf, bufLength, length, "%-32s\tP50: %10llu\tP90: %10llu\tP99: %10llu\tMAX: %10llu\n", GetProfileName(i),
+					  GetProfilePercentile(histogram, count, 50.0), GetProfilePercentile(histogram, count, 90.0),
+					  GetProfilePercentile(histogram, count, 99.0), histogram->maxCycles);
+	}
+}
+
+void WriteProfileHistogramsJSON(FILE * file)
+{
+	bool first = true;
+	fprintf(file, ", \"latency\": [");
+	for(uint i = 0; i < MAX_PROFILE_HISTOGRAMS; ++i)
+	{
+		ProfileHistogram * histogram = &mergedProfileHistogram;
+		uint64 count = MergeProfileHistograms(i, histogram);
+		if(count == 0)
+		{
+			continue;
+		}
+		fprintf(file, "%s\n  {\"name\": \"%s\", \"calls\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu, \"buckets\": [",
+				first ? "" : ",", GetProfileName(i), count, GetProfilePercentile(histogram, count, 50.0), GetProfilePercentile(histogram, count, 90.0),
+				GetProfilePercentile(histogram, count, 99.0), histogram->maxCycles);
+		// non-empty buckets only, as [cycles, count]
+		bool firstBucket = true;
+		for(uint b = 0; b < PROFILE_HISTOGRAM_BUCKETS; ++b)
+		{
+			if(histogram->buckets[b])
+			{
+				fprintf(file, "%s[%llu, %llu]", firstBucket ? "" : ", ", GetProfileHistogramValue(b), histogram->buckets[b]);
+				firstBucket = false;
+			}
+		}
+		fprintf(file, "]}");
+		first = false;
+	}
+	fprintf(file, "]");
+}
+#endif
+
+int PrintProfileTree_(char * buf, uint bufLength)
+{
+	uint length = 0;
+	ProfileTree * tree = MergeProfileTrees();
+	ProfileAppend(buf, bufLength, &length, "CC: Call Count\t IN: Inclusive rdtsc\t SF: Self rdtsc\t %%: of total\n\n");
+	for(int c = tree->nodes[0].firstChild; c; c = tree->nodes[c].nextSibling)
+	{
+		PrintProfileNode(tree, c, 0, tree->nodes[0].inclusiveCycles, buf, bufLength, &length);
+	}
+#if PROFILE_HISTOGRAMS
+	PrintProfileHistograms(buf, bufLength, &length);
+#endif
+#if MEMORY_TRACKING
+	PrintMemoryStats(buf, bufLength, &length);
+#endif
 	return length;
 }
 
+void WriteProfileNodeJSON(FILE * file, ProfileTree * tree, int nodeIndex, int depth)
+{
+	ProfileNode * node = &tree->nodes[nodeIndex];
+	fprintf(file, "%*s{\"name\": \"%s\", \"calls\": %llu, \"inclusiveCycles\": %llu, \"selfCycles\": %llu, \"children\": [",
+			depth*2, "", nodeIndex ? GetProfileName(node->recordIndex) : "root",
+			node->callCount, node->inclusiveCycles, node->inclusiveCycles - node->childCycles);
+	for(int c = node->firstChild; c; c = tree->nodes[c].nextSibling)
+	{
+		fprintf(file, "\n");
+		WriteProfileNodeJSON(file, tree, c, depth + 1);
+		if(tree->nodes[c].nextSibling)
+		{
+			fprintf(file, ",");
+		}
+	}
+	fprintf(file, "]}");
+}
+
+bool WriteProfileJSON_(const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if(!file)
+	{
+		OutputDebugStringA("Failed to write profile!");
+		return false;
+	}
+	ProfileTree * tree = MergeProfileTrees();
+	fprintf(file, "{\"threads\": %d, \"tree\":\n", gThreadCounter);
+	WriteProfileNodeJSON(file, tree, 0, 1);
+#if PROFILE_HISTOGRAMS
+	WriteProfileHistogramsJSON(file);
+#endif
+#if MEMORY_TRACKING
+	WriteMemoryStatsJSON(file);
+#endif
+	fprintf(file, "\n}\n");
+	fclose(file);
+	return true;
+}
+
+#endif
 
 #ifdef PROFILE
 
 	#define SCOPED_PROFILE(n) ProfileProxy proxy##n = ProfileProxy(__COUNTER__, n)
 	#define PROFILED_FUNCTION SCOPED_PROFILE(__FUNCTION__)
+	#define PROFILED_BLOCK(n) ProfileProxy proxy##n = ProfileProxy(__COUNTER__, #n)
+#if PROFILE_LEVEL >= PROFILE_LEVEL_FINE
 	#define SCOPED_PROFILE_FAST(n) ProfileProxyFast proxy##n = ProfileProxyFast(__COUNTER__, n)
 	#define PROFILED_FUNCTION_FAST SCOPED_PROFILE_FAST(__FUNCTION__)
+	#define PROFILED_BLOCK_FAST(n) ProfileProxyFast proxy##n = ProfileProxyFast(__COUNTER__, #n)
+#else
+	#define SCOPED_PROFILE_FAST(n)
+	#define PROFILED_FUNCTION_FAST
+	#define PROFILED_BLOCK_FAST(n)
+#endif
 
 	#define BEGIN_PROFILE(n) 																			\
 		int index##n = __COUNTER__;																		\
+		bool enabled##n = gProfileEnabled;																\
 		uint64 startTime##n = GetHiresTime();															\
 		uint64 startCycles##n = GetCycles();															\
-		if(profile[index##n].callCount == 0)															\
+		if(enabled##n && profile[index##n].callCount == 0)												\
 		{																								\
 			profile[index##n] = {};																		\
 			strncpy(profile[index##n].name, #n, PROFILE_NAME_MAX_LENGTH);								\
-		}
+		}																								\
+		int node##n = enabled##n ? ProfileEnterLocalNode(index##n) : -1;
 
 
 
 	#define END_PROFILE(n)																				\
-		profile[index##n].cyclesTotal += GetCycles() - startCycles##n;									\
-		profile[index##n].timeTotal += GetHiresTime() - startTime##n;									\
-		profile[index##n].callCount++;
+		if(enabled##n)																					\
+		{																								\
+			ProfileExitLocalNode(node##n, GetCycles() - startCycles##n);								\
+			RecordProfileLatency(GetLocalProfileHistogram(index##n), GetCycles() - startCycles##n);	\
+			profile[index##n].cyclesTotal += GetCycles() - startCycles##n;								\
+			profile[index##n].timeTotal += GetHiresTime() - startTime##n;								\
+			profile[index##n].callCount++;																\
+		}
 
+#if PROFILE_HIERARCHY
+	#define PrintProfile(b, l) PrintProfileTree_((b), (l))
+	#define WriteProfileJSON(path) WriteProfileJSON_(path)
+#else
 	#define PrintProfile(b, l) PrintProfile_((b), (l))
-	#define InitProfiler() InitProfiler_()
+	#define WriteProfileJSON(path)
+#endif
 
 #else
 	#define SCOPED_PROFILE(n)
 	#define PROFILED_FUNCTION
 	#define SCOPED_PROFILE_FAST(n)
 	#define PROFILED_FUNCTION_FAST
+	#define PROFILED_BLOCK(n)
+	#define PROFILED_BLOCK_FAST(n)
 	#define BEGIN_PROFILE(n)
 	#define END_PROFILE(n)
-	#define InitProfiler()
 	#define PrintProfile(b, l) 0
+	#define WriteProfileJSON(path)
 #endif
+
+// NOTE: always initialized, the timer frequency is used outside of the profiler too
+#define InitProfiler() InitProfiler_()
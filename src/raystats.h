@@ -0,0 +1,134 @@
+#pragma once
+
+// Ray throughput counters. Every thread counts into its own cache line aligned block,
+// plain increments with no atomics, and the blocks are summed when the stats are shown.
+// The display thread reads them while the render threads write, which is fine for a
+// live readout since aligned 64 bit loads and stores don't tear on x64.
+
+// ray counts are per ray and always kept, box and primitive tests are per-primitive
+// code and only counted at PROFILE_LEVEL_FINE
+#if PROFILE_LEVEL > PROFILE_LEVEL_OFF
+#define RAY_STATS 1
+#endif
+
+enum RayType
+{
+	RAY_PRIMARY,
+	RAY_SHADOW,
+	RAY_SECONDARY,
+	RAY_REFLECTION,
+	RAY_TYPE_COUNT
+};
+
+const char * rayTypeNames[RAY_TYPE_COUNT] = {"Primary", "Shadow", "Secondary", "Reflection"};
+
+// bounce histogram: camera and secondary rays traced at each diffuse bounce
+// path length histogram: paths (ray tree leaves) ending after that many diffuse bounces
+#define RAY_HISTOGRAM_SIZE (MAX_DIFFUSE_BOUNCES + 1)
+
+struct __declspec(align(CACHE_LINE_SIZE)) RayStats
+{
+	uint64 rays[RAY_TYPE_COUNT];
+	uint64 boxTests;
+	uint64 primitiveTests;
+	uint64 bounces[RAY_HISTOGRAM_SIZE];
+	uint64 pathLengths[RAY_HISTOGRAM_SIZE];
+};
+
+RayStats rayStats[PROGRAM_THREAD_COUNT];
+
+inline uint64 GetLocalRayCount()
+{
+	RayStats * stats = &rayStats[LOCAL_THREAD_ID];
+	uint64 count = 0;
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		count += stats->rays[i];
+	}
+	return count;
+}
+
+void MergeRayStats(RayStats * total)
+{
+	*total = {};
+	for(int t = 0; t < gThreadCounter; ++t)
+	{
+		RayStats * stats = &rayStats[t];
+		for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+		{
+			total->rays[i] += stats->rays[i];
+		}
+		total->boxTests += stats->boxTests;
+		total->primitiveTests += stats->primitiveTests;
+		for(int i = 0; i < RAY_HISTOGRAM_SIZE; ++i)
+		{
+			total->bounces[i] += stats->bounces[i];
+			total->pathLengths[i] += stats->pathLengths[i];
+		}
+	}
+}
+
+void PrintRayHistogram(char * buf, uint bufLength, uint * length, const char * name, uint64 * histogram, int bucketCount)
+{
+	ProfileAppend(buf, bufLength, length, "%-12s", name);
+	for(int i = 0; i < bucketCount; ++i)
+	{
+		ProfileAppend(buf, bufLength, length, "%d: %8.3fM  ", i, histogram[i] / 1000000.0);
+	}
+	ProfileAppend(buf, bufLength, length, "\n");
+}
+
+// seconds is the render time so far, or the total render time once it is finished
+int PrintRayStats_(char * buf, int bufLength, double seconds)
+{
+	RayStats total;
+	MergeRayStats(&total);
+
+	uint64 totalRays = 0;
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		totalRays += total.rays[i];
+	}
+	double megaRaysPerSecond = seconds > 0.0 ? totalRays / seconds / 1000000.0 : 0.0;
+
+	uint capacity = bufLength > 0 ? (uint)bufLength : 0;
+	uint length = 0;
+	ProfileAppend(buf, capacity, &length, "Rays: %.3fM  %.2f Mrays/s\n", totalRays / 1000000.0, megaRaysPerSecond);
+	for(int i = 0; i < RAY_TYPE_COUNT; ++i)
+	{
+		ProfileAppend(buf, capacity, &length, "%-12s%10.3fM  %8.2f Mrays/s\n",
+					  rayTypeNames[i], total.rays[i] / 1000000.0, seconds > 0.0 ? total.rays[i] / seconds / 1000000.0 : 0.0);
+	}
+#if PROFILE_LEVEL >= PROFILE_LEVEL_FINE
+	ProfileAppend(buf, capacity, &length, "Box tests: %.3fM  Primitive tests: %.3fM  per ray: %.2f / %.2f\n",
+				  total.boxTests / 1000000.0, total.primitiveTests / 1000000.0,
+				  totalRays ? (double)total.boxTests / totalRays : 0.0, totalRays ? (double)total.primitiveTests / totalRays : 0.0);
+#endif
+
+	// only the bounces the current settings can reach
+	int bucketCount = min(gSettings.maxDiffuseBounces + 1, RAY_HISTOGRAM_SIZE);
+	PrintRayHistogram(buf, capacity, &length, "Bounce", total.bounces, bucketCount);
+	PrintRayHistogram(buf, capacity, &length, "Path length", total.pathLengths, bucketCount);
+	return (int)length;
+}
+
+#ifdef RAY_STATS
+	#define COUNT_RAY(type) rayStats[LOCAL_THREAD_ID].rays[type]++
+#if PROFILE_LEVEL >= PROFILE_LEVEL_FINE
+	#define COUNT_BOX_TESTS(n) rayStats[LOCAL_THREAD_ID].boxTests += (n)
+	#define COUNT_PRIMITIVE_TESTS(n) rayStats[LOCAL_THREAD_ID].primitiveTests += (n)
+#else
+	#define COUNT_BOX_TESTS(n)
+	#define COUNT_PRIMITIVE_TESTS(n)
+#endif
+	#define COUNT_BOUNCE(bounce) rayStats[LOCAL_THREAD_ID].bounces[bounce]++
+	#define COUNT_PATH_END(bounce) rayStats[LOCAL_THREAD_ID].pathLengths[bounce]++
+	#define PrintRayStats(b, l, s) PrintRayStats_((b), (l), (s))
+#else
+	#define COUNT_RAY(type)
+	#define COUNT_BOX_TESTS(n)
+	#define COUNT_PRIMITIVE_TESTS(n)
+	#define COUNT_BOUNCE(bounce)
+	#define COUNT_PATH_END(bounce)
+	#define PrintRayStats(b, l, s) 0
+#endif
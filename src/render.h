@@ -1,9 +1,9 @@
 #pragma once
 
-#define SAMPLES_PER_PIXEL 1
 #define MAX_REFLECTION_DEPTH 0
-#define MAX_DIFFUSE_BOUNCES 1
-#define SECONDARY_RAYS (30*30)
+
+// NOTE: template arguments set to RUNTIME_PARAMETER are read from gSettings instead
+#define RUNTIME_PARAMETER -1
 
 
 V2 sampleGrid[][8] = {
@@ -43,10 +43,10 @@ struct Viewport
 	float h;
 };
 
-void PutPixel(V4 * bitmap, int x, int y, V4 color)
+void PutPixel(V4 * bitmap, int stride, int x, int y, V4 color)
 {
 // PROFILED_FUNCTION;
-	bitmap[y*WIDTH + x] = color;
+	bitmap[y*stride + x] = color;
 }
 
 V4 Schlick(V4 rf0, float cosTheta)
@@ -55,27 +55,105 @@ V4 Schlick(V4 rf0, float cosTheta)
 	return reflectance;
 }
 
-bool TraceRay(Ray r, Scene * s, Intersection * out_ix, Object ** out_io)
+// The range intersectors test count primitives of one type from first and keep the closest
+// hit in ix if it is nearer than ix->t already is. They return the index of the primitive
+// hit, ~0u when none got closer.
+uint IntersectSphereRange(Ray r, Scene * s, uint first, uint count, Intersection * ix)
+{
+	COUNT_PRIMITIVE_TESTS(count);
+	uint hit = ~0u;
+	float tMin = ix->t;
+	// IntersectRaySphere on the columns, the hit point and normal only for the closest one
+	for(uint i = first; i < first + count; ++i)
+	{
+		float lx = s->sphereX[i] - r.o.x;
+		float ly = s->sphereY[i] - r.o.y;
+		float lz = s->sphereZ[i] - r.o.z;
+		float rr = s->sphereRadius[i] * s->sphereRadius[i];
+		float sd = lx*r.d.x + ly*r.d.y + lz*r.d.z;
+		float ll = lx*lx + ly*ly + lz*lz;
+		if(sd < 0 && ll > rr) continue;
+
+		float mm = ll - sd*sd;
+		if(mm > rr) continue;
+
+		float q = sqrtf(rr - mm);
+		float t = ll > rr ? sd - q : sd + q;
+		if(t < tMin)
+		{
+			tMin = t;
+			hit = i;
+		}
+	}
+
+	if(hit != ~0u)
+	{
+		V3 center = {s->sphereX[hit], s->sphereY[hit], s->sphereZ[hit]};
+		ix->t = tMin;
+		ix->point = r.o + r.d*tMin;
+		ix->normal = Normalize(ix->point - center);
+	}
+	return hit;
+}
+
+uint IntersectPlaneRange(Ray r, Scene * s, uint first, uint count, Intersection * ix)
 {
+	uint hit = ~0u;
+	for(uint i = first; i < first + count; ++i)
+	{
+		Intersection intermix;
+		if(IntersectRayPlane(r, s->planes[i], &intermix) && intermix.t < ix->t)
+		{
+			*ix = intermix;
+			hit = i;
+		}
+	}
+	return hit;
+}
+
+uint IntersectMeshRange(Ray r, Scene * s, uint first, uint count, Intersection * ix)
+{
+	uint hit = ~0u;
+	for(uint i = first; i < first + count; ++i)
+	{
+		// only reports hits closer than ix->t
+		if(TryIntersectRayMesh(r, &s->meshes[i], ix))
+		{
+			hit = i;
+		}
+	}
+	return hit;
+}
+
+// out_io is the index of the object hit
+bool TraceRay(Ray r, Scene * s, Intersection * out_ix, uint * out_io, RayType type)
+{
+PROFILED_FUNCTION_FAST;
+	COUNT_RAY(type);
 	bool result = false;
 	Intersection ix;
-	Object * io = nullptr;
+	uint io = 0;
 	ix.t = 1000000000;
 	bool intersectionFound = false;
 
-	for(unsigned int i = 0; i < s->objectCount; ++i)
+	// each range only reports a hit closer than the ones before, so the last one wins
+	uint sphere = IntersectSphereRange(r, s, 0, s->sphereCount, &ix);
+	uint plane = IntersectPlaneRange(r, s, 0, s->planeCount, &ix);
+	uint mesh = IntersectMeshRange(r, s, 0, s->meshCount, &ix);
+	if(mesh != ~0u)
 	{
-		Object * o = &s->objects[i];
-		Intersection intermix;
-		if(Intersect(r, o->geometry, &intermix))
-		{
-			if(intermix.t < ix.t)
-			{
-				intersectionFound = true;
-				ix = intermix;
-				io = o;
-			}
-		}
+		intersectionFound = true;
+		io = s->meshObjects[mesh];
+	}
+	else if(plane != ~0u)
+	{
+		intersectionFound = true;
+		io = s->planeObjects[plane];
+	}
+	else if(sphere != ~0u)
+	{
+		intersectionFound = true;
+		io = s->sphereObjects[sphere];
 	}
 
 	if(intersectionFound)
@@ -94,22 +172,32 @@ bool TraceRay(Ray r, Scene * s, Intersection * out_ix, Object ** out_io)
 	return result;
 }
 
+template<int MaxBounces, int SecondaryRays>
 V4 ComputeRadiance(Ray ray, Scene * scene, int depth, int bounce)
 {
+	const int maxBounces = MaxBounces == RUNTIME_PARAMETER ? gSettings.maxDiffuseBounces : MaxBounces;
+	const int secondaryRayCount = SecondaryRays == RUNTIME_PARAMETER ? gSettings.secondaryRays : SecondaryRays;
+
 	V4 radiance = {};
 	Intersection ix;
-	Object * io = nullptr;
+	uint io = 0;
 
 	Material matGray;
 	matGray.diffuse = {0.8f, 0.8f, 0.8f, 1.0f};
 	matGray.rf0 = V4::FromFloat(0.001f);
 	matGray.isConductor = false;
 
-	if(TraceRay(ray, scene, &ix, &io))
+	RayType rayType = bounce > 0 ? RAY_SECONDARY : (depth > 0 ? RAY_REFLECTION : RAY_PRIMARY);
+	if(rayType != RAY_REFLECTION)
+	{
+		COUNT_BOUNCE(bounce);
+	}
+
+	if(TraceRay(ray, scene, &ix, &io, rayType))
 	{
 
 		// V3 toCam = -ray.d;
-		Material * mat = &io->material;
+		Material * mat = &scene->materials[io];
 #if 0
 		mat = &matGray;
 #endif
@@ -118,16 +206,21 @@ V4 ComputeRadiance(Ray ray, Scene * scene, int depth, int bounce)
 		V4 diffuseRadiance = {};
 
 		// indirect
-		if(bounce < MAX_DIFFUSE_BOUNCES/* && ray.d.y < 0*/)
+		if(bounce >= maxBounces)
+		{
+			COUNT_PATH_END(bounce);
+		}
+		else/* if(ray.d.y < 0)*/
 		{
-			Ray secondaryRays[SECONDARY_RAYS];
-			V3 samples[SECONDARY_RAYS];
-			//uint sampleCount = GetUniformSamplesOnHemisphere(SECONDARY_RAYS, samples);
+			PROFILED_BLOCK_FAST(SecondaryRays);
+			Ray secondaryRays[SecondaryRays == RUNTIME_PARAMETER ? MAX_SECONDARY_RAYS : SecondaryRays];
+			V3 samples[SecondaryRays == RUNTIME_PARAMETER ? MAX_SECONDARY_RAYS : SecondaryRays];
+			//uint sampleCount = GetUniformSamplesOnHemisphere(secondaryRayCount, samples);
 			uint sampleCount = 0;
-			sampleCount = GetJitteredSamplesOnHemisphere(SECONDARY_RAYS, samples);
-			//sampleCount = GetRandomSamplesOnHemisphere(SECONDARY_RAYS, samples);
-			//uint sampleCount = GetRandomSamplesOnHemisphere(SECONDARY_RAYS, samples);
-			// uint sampleCount = SECONDARY_RAYS;
+			sampleCount = GetJitteredSamplesOnHemisphere(secondaryRayCount, samples);
+			//sampleCount = GetRandomSamplesOnHemisphere(secondaryRayCount, samples);
+			//uint sampleCount = GetRandomSamplesOnHemisphere(secondaryRayCount, samples);
+			// uint sampleCount = secondaryRayCount;
 			for(uint i = 0; i < sampleCount; ++i)
 			{
 				V3 transformedDir = RotateSample(samples[i], ix.normal);
@@ -140,7 +233,7 @@ V4 ComputeRadiance(Ray ray, Scene * scene, int depth, int bounce)
 
 			for(uint i = 0; i < sampleCount; ++i)
 			{
-				V4 sampledRadiance = ComputeRadiance(secondaryRays[i], scene, depth, bounce+1);
+				V4 sampledRadiance = ComputeRadiance<MaxBounces, SecondaryRays>(secondaryRays[i], scene, depth, bounce+1);
 				float cosTheta = Dot(ix.normal, secondaryRays[i].d);
 				diffuseRadiance += sampledRadiance * cosTheta;
 			}
@@ -162,10 +255,11 @@ V4 ComputeRadiance(Ray ray, Scene * scene, int depth, int bounce)
 					//V4 diffuseRadiance = mat->diffuse * (light->intensity / lightDistanceSq);
 
 					// shadow
+					PROFILED_BLOCK_FAST(ShadowRay);
 					Ray shadowRay = {ix.point, toLight};
 					Intersection shadowIx;
 					float shadowFactor = 1.0f; // fully lit
-					if(TraceRay(shadowRay, scene, &shadowIx, 0))
+					if(TraceRay(shadowRay, scene, &shadowIx, 0, RAY_SHADOW))
 					{
 						if(shadowIx.t*shadowIx.t < lightDistanceSq)
 						{
@@ -189,10 +283,15 @@ V4 ComputeRadiance(Ray ray, Scene * scene, int depth, int bounce)
 			Ray reflectionRay = {ix.point, reflectionVector};
 			float cosTheta = Dot(ix.normal, reflectionVector);
 			specularReflectance = Schlick(mat->rf0, cosTheta);
-			reflectedRadiance = cosTheta * ComputeRadiance(reflectionRay, scene, depth + 1, bounce);
+			reflectedRadiance = cosTheta * ComputeRadiance<MaxBounces, SecondaryRays>(reflectionRay, scene, depth + 1, bounce);
 		}
 
-		radiance = io->material.emissive*io->material.power + ComponentMultiply(V4::FromFloat(1.0f) - specularReflectance, diffuseRadiance) + ComponentMultiply(specularReflectance, reflectedRadiance);
+		radiance = scene->materials[io].emissive*scene->materials[io].power + ComponentMultiply(V4::FromFloat(1.0f) - specularReflectance, diffuseRadiance) + ComponentMultiply(specularReflectance, reflectedRadiance);
+	}
+	else if(rayType != RAY_REFLECTION)
+	{
+		// escaped the scene
+		COUNT_PATH_END(bounce);
 	}
 
 	return radiance;
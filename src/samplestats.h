@@ -0,0 +1,553 @@
+#pragma once
+
+// Quality of the sample patterns from sampler.h, run on the main thread by rtbench -samplers.
+// For every generator, averaged over SAMPLE_STATS_TRIALS seeds:
+//   star discrepancy     largest difference between the fraction of samples in a box anchored
+//                        at the origin and the box's area, over all such boxes (exact, O(n^2)),
+//                        and the L2 version of it (Warnock's formula)
+//   power spectrum       |sum exp(-2 pi i f.x)|^2 / n over integer frequencies f, radially
+//                        averaged. White noise is 1 everywhere, blue noise (and jittering) is
+//                        low near 0, grids show spikes
+//   integration error    RMSE of the estimate of test integrals with known values, and the
+//                        slope of log RMSE over log sample count: -0.5 is plain Monte Carlo,
+//                        anything steeper converges faster per ray
+//
+// Discrepancy and spectrum are measured in [0,1]^d, each domain is mapped there by an area
+// (or volume) preserving map, so uniform samples on the domain stay uniform. The spectrum
+// is only computed for 2D domains. Integrands are in the domain's own coordinates.
+//
+// To compare a new generator add it to sampleGenerators, with its domain.
+
+#define SAMPLE_STATS_TRIALS 64
+#define SAMPLE_SPECTRUM_TRIALS 16
+#define SAMPLE_SPECTRUM_COUNT 256
+#define SAMPLE_SPECTRUM_MAX_FREQUENCY 32
+#define SAMPLE_STATS_MAX_COUNT 1024
+
+// powers of 4, so the grid based generators give exactly this many
+uint sampleStatsCounts[] = {16, 64, 256, 1024};
+#define SAMPLE_STATS_COUNT_COUNT (sizeof(sampleStatsCounts)/sizeof(sampleStatsCounts[0]))
+
+enum SampleDomain
+{
+	SAMPLE_DOMAIN_SQUARE, // [-1,1]^2 at z = 0
+	SAMPLE_DOMAIN_DISK, // unit disk at z = 0
+	SAMPLE_DOMAIN_HEMISPHERE, // unit directions around +Z
+	SAMPLE_DOMAIN_CUBE, // [-1,1]^3
+	SAMPLE_DOMAIN_CUBE_SURFACE, // surface of [-1,1]^3
+	SAMPLE_DOMAIN_COUNT
+};
+
+const char * sampleDomainNames[SAMPLE_DOMAIN_COUNT] = {"square", "disk", "hemisphere", "cube", "cubeSurface"};
+double sampleDomainMeasures[SAMPLE_DOMAIN_COUNT] = {4.0, PI, PI2, 8.0, 24.0};
+int sampleDomainDimensions[SAMPLE_DOMAIN_COUNT] = {2, 2, 2, 3, 2};
+
+typedef uint (*SampleGenerator)(uint requestedSampleCount, V3 * samples);
+
+struct SampleGeneratorInfo
+{
+	const char * name;
+	SampleGenerator generate;
+	SampleDomain domain;
+};
+
+// GetRandomSamplesOnUnitCubeSurface returns nothing
+uint GetRandomSamplesOnUnitCubeSurfaceCounted(uint sampleCount, V3 * samples)
+{
+	GetRandomSamplesOnUnitCubeSurface(sampleCount, samples);
+	return sampleCount;
+}
+
+SampleGeneratorInfo sampleGenerators[] = {
+	{"GetRandomSamplesOnUnitCubeSurface", GetRandomSamplesOnUnitCubeSurfaceCounted, SAMPLE_DOMAIN_CUBE_SURFACE},
+	{"GetRandomSamplesInUnitCube", GetRandomSamplesInUnitCube, SAMPLE_DOMAIN_CUBE},
+	{"GetRandomSamplesOnHemisphere", GetRandomSamplesOnHemisphere, SAMPLE_DOMAIN_HEMISPHERE},
+	{"GetRandomSamplesOnDisk", GetRandomSamplesOnDisk, SAMPLE_DOMAIN_DISK},
+	{"GetUniformSamplesOnSquare", GetUniformSamplesOnSquare, SAMPLE_DOMAIN_SQUARE},
+	{"GetUniformSamplesOnDisk", GetUniformSamplesOnDisk, SAMPLE_DOMAIN_DISK},
+	{"GetUniformSamplesOnHemisphere", GetUniformSamplesOnHemisphere, SAMPLE_DOMAIN_HEMISPHERE},
+	{"GetJitteredSamplesOnSquare", GetJitteredSamplesOnSquare, SAMPLE_DOMAIN_SQUARE},
+	{"GetJitteredSamplesOnDisk", GetJitteredSamplesOnDisk, SAMPLE_DOMAIN_DISK},
+	{"GetJitteredSamplesOnHemisphere", GetJitteredSamplesOnHemisphere, SAMPLE_DOMAIN_HEMISPHERE},
+};
+
+/* Integrands */
+
+struct SampleIntegrand
+{
+	const char * name;
+	SampleDomain domain;
+	double (*f)(V3 s);
+	double exact;
+};
+
+// an edge at an angle no grid lines up with
+#define INTEGRAND_EDGE_ANGLE 0.3
+#define INTEGRAND_EDGE_OFFSET 0.25
+
+double IntegrandRadiusSq(V3 s)
+{
+	return (double)s.x * s.x + (double)s.y * s.y + (double)s.z * s.z;
+}
+
+double IntegrandGaussian(V3 s)
+{
+	return exp(-IntegrandRadiusSq(s));
+}
+
+double IntegrandBall(V3 s)
+{
+	return IntegrandRadiusSq(s) < 0.75 * 0.75 ? 1.0 : 0.0;
+}
+
+double IntegrandEdge(V3 s)
+{
+	return s.x * cos(INTEGRAND_EDGE_ANGLE) + s.y * sin(INTEGRAND_EDGE_ANGLE) > INTEGRAND_EDGE_OFFSET ? 1.0 : 0.0;
+}
+
+// irradiance from a constant sky
+double IntegrandCosine(V3 s)
+{
+	return s.z;
+}
+
+// a constant sky with half of it blocked, the edge through the zenith
+double IntegrandHalfOccluded(V3 s)
+{
+	return s.x * cos(INTEGRAND_EDGE_ANGLE) + s.y * sin(INTEGRAND_EDGE_ANGLE) > 0.0 ? s.z : 0.0;
+}
+
+// a glossy lobe 30 degrees off the normal, narrow enough that it doesn't reach the horizon
+double IntegrandLobe(V3 s)
+{
+	double d = s.x * 0.5 + s.z * 0.8660254;
+	return d > 0.0 ? pow(d, 32.0) : 0.0;
+}
+
+// erf(1) * sqrt(pi), the integral of exp(-x^2) over [-1,1]
+#define GAUSSIAN_INTEGRAL_1D 1.4936482656248541
+
+SampleIntegrand sampleIntegrands[] = {
+	{"radiusSq", SAMPLE_DOMAIN_SQUARE, IntegrandRadiusSq, 8.0 / 3.0},
+	{"gaussian", SAMPLE_DOMAIN_SQUARE, IntegrandGaussian, GAUSSIAN_INTEGRAL_1D * GAUSSIAN_INTEGRAL_1D},
+	{"disk", SAMPLE_DOMAIN_SQUARE, IntegrandBall, PI * 0.75 * 0.75},
+	{"radiusSq", SAMPLE_DOMAIN_DISK, IntegrandRadiusSq, PI / 2.0},
+	{"gaussian", SAMPLE_DOMAIN_DISK, IntegrandGaussian, PI * (1.0 - exp(-1.0))},
+	// circular segment beyond the edge
+	{"edge", SAMPLE_DOMAIN_DISK, IntegrandEdge, acos(INTEGRAND_EDGE_OFFSET) - INTEGRAND_EDGE_OFFSET * sqrt(1.0 - INTEGRAND_EDGE_OFFSET * INTEGRAND_EDGE_OFFSET)},
+	{"cosine", SAMPLE_DOMAIN_HEMISPHERE, IntegrandCosine, PI},
+	{"halfOccluded", SAMPLE_DOMAIN_HEMISPHERE, IntegrandHalfOccluded, PI / 2.0},
+	{"lobe", SAMPLE_DOMAIN_HEMISPHERE, IntegrandLobe, PI2 / 33.0},
+	{"radiusSq", SAMPLE_DOMAIN_CUBE, IntegrandRadiusSq, 8.0},
+	{"gaussian", SAMPLE_DOMAIN_CUBE, IntegrandGaussian, GAUSSIAN_INTEGRAL_1D * GAUSSIAN_INTEGRAL_1D * GAUSSIAN_INTEGRAL_1D},
+	{"ball", SAMPLE_DOMAIN_CUBE, IntegrandBall, 4.0 / 3.0 * PI * 0.75 * 0.75 * 0.75},
+	{"radiusSq", SAMPLE_DOMAIN_CUBE_SURFACE, IntegrandRadiusSq, 6.0 * (4.0 + 8.0 / 3.0)},
+	{"gaussian", SAMPLE_DOMAIN_CUBE_SURFACE, IntegrandGaussian, 6.0 * exp(-1.0) * GAUSSIAN_INTEGRAL_1D * GAUSSIAN_INTEGRAL_1D},
+};
+
+/* Measures */
+
+// area preserving map from the domain to [0,1]^d
+void GetUnitCoordinates(V3 s, SampleDomain domain, double * u)
+{
+	switch(domain)
+	{
+		case SAMPLE_DOMAIN_SQUARE:
+		{
+			u[0] = (s.x + 1.0) * 0.5;
+			u[1] = (s.y + 1.0) * 0.5;
+		} break;
+		case SAMPLE_DOMAIN_DISK:
+		{
+			u[0] = (double)s.x * s.x + (double)s.y * s.y;
+			u[1] = atan2((double)s.y, (double)s.x) / PI2 + 0.5;
+		} break;
+		case SAMPLE_DOMAIN_HEMISPHERE:
+		{
+			u[0] = s.z; // uniform in z on the hemisphere
+			u[1] = atan2((double)s.y, (double)s.x) / PI2 + 0.5;
+		} break;
+		case SAMPLE_DOMAIN_CUBE:
+		{
+			u[0] = (s.x + 1.0) * 0.5;
+			u[1] = (s.y + 1.0) * 0.5;
+			u[2] = (s.z + 1.0) * 0.5;
+		} break;
+		case SAMPLE_DOMAIN_CUBE_SURFACE:
+		{
+			// six faces side by side along u[0]
+			int axis = fabsf(s.x) >= fabsf(s.y) && fabsf(s.x) >= fabsf(s.z) ? 0 : (fabsf(s.y) >= fabsf(s.z) ? 1 : 2);
+			float a = axis == 0 ? s.y : s.x;
+			float b = axis == 2 ? s.y : s.z;
+			int face = axis * 2 + (s[axis] < 0.0f ? 1 : 0);
+			u[0] = (face + (a + 1.0) * 0.5) / 6.0;
+			u[1] = (b + 1.0) * 0.5;
+		} break;
+		default: break;
+	}
+	for(int i = 0; i < 3; ++i)
+	{
+		u[i] = min(max(u[i], 0.0), 1.0);
+	}
+}
+
+// Sorts values and removes duplicates, then appends 1.0 unless it's there. Returns the count.
+uint GetDiscrepancyCorners(double * values, uint count)
+{
+	qsort(values, count, sizeof(double), CompareDoubles);
+	uint unique = 0;
+	for(uint i = 0; i < count; ++i)
+	{
+		if(unique == 0 || values[i] != values[unique - 1])
+		{
+			values[unique++] = values[i];
+		}
+	}
+	if(unique == 0 || values[unique - 1] < 1.0)
+	{
+		values[unique++] = 1.0;
+	}
+	return unique;
+}
+
+// Exact 2D star discrepancy. The supremum is at a box whose corner has coordinates taken from
+// the samples (or 1), counting the samples on the box's upper edges (closed box) or not (open
+// box). points holds n (x, y) pairs, scratch 4n + 4 doubles and n + 1 uints.
+double GetStarDiscrepancy2D(double * points, uint n, double * scratch, uint * counts)
+{
+	double * xs = scratch;
+	double * ys = scratch + n + 1;
+	double * order = scratch + 2 * n + 2; // (x, y index) pairs sorted by x
+	for(uint i = 0; i < n; ++i)
+	{
+		xs[i] = points[2 * i];
+		ys[i] = points[2 * i + 1];
+	}
+	uint xCount = GetDiscrepancyCorners(xs, n);
+	uint yCount = GetDiscrepancyCorners(ys, n);
+	for(uint i = 0; i < n; ++i)
+	{
+		double y = points[2 * i + 1];
+		uint yIndex = 0;
+		while(ys[yIndex] < y)
+		{
+			yIndex++;
+		}
+		order[2 * i] = points[2 * i];
+		order[2 * i + 1] = (double)yIndex;
+	}
+	qsort(order, n, 2 * sizeof(double), CompareDoubles);
+
+	// counts[k] is the number of samples left of the current corner with y at ys[k]
+	memset(counts, 0, (n + 1) * sizeof(uint));
+	double result = 0.0;
+	uint next = 0;
+	for(uint i = 0; i < xCount; ++i)
+	{
+		double x = xs[i];
+		uint openCount = 0;
+		uint closedCount = 0;
+		uint first = next;
+		while(next < n && order[2 * next] == x)
+		{
+			next++;
+		}
+		// the samples at exactly x count for the closed box only
+		for(uint k = 0; k < yCount; ++k)
+		{
+			uint onEdge = 0;
+			for(uint j = first; j < next; ++j)
+			{
+				onEdge += (uint)order[2 * j + 1] == k ? 1 : 0;
+			}
+			double area = x * ys[k];
+			result = max(result, area - (double)openCount / n);
+			openCount += counts[k];
+			closedCount += counts[k] + onEdge;
+			result = max(result, (double)closedCount / n - area);
+		}
+		for(uint j = first; j < next; ++j)
+		{
+			counts[(uint)order[2 * j + 1]]++;
+		}
+	}
+	return result;
+}
+
+// L2 star discrepancy by Warnock's formula, any dimension. points holds n tuples of d.
+double GetL2StarDiscrepancy(double * points, uint n, int d)
+{
+	double single = 0.0;
+	double pairs = 0.0;
+	for(uint i = 0; i < n; ++i)
+	{
+		double * p = points + i * d;
+		double product = 1.0;
+		for(int k = 0; k < d; ++k)
+		{
+			product *= 1.0 - p[k] * p[k];
+		}
+		single += product;
+		for(uint j = 0; j < n; ++j)
+		{
+			double * q = points + j * d;
+			double pairProduct = 1.0;
+			for(int k = 0; k < d; ++k)
+			{
+				pairProduct *= 1.0 - max(p[k], q[k]);
+			}
+			pairs += pairProduct;
+		}
+	}
+	double squared = pow(3.0, -d) - pow(2.0, 1 - d) / n * single + pairs / ((double)n * n);
+	return sqrt(max(squared, 0.0));
+}
+
+// Adds the radially averaged power spectrum of the 2D points to spectrum, one bin per integer
+// frequency radius from 0 to SAMPLE_SPECTRUM_MAX_FREQUENCY. The DC term (always n) is left out.
+void AddRadialSpectrum(double * points, uint n, double * spectrum, uint * binCounts)
+{
+	const int F = SAMPLE_SPECTRUM_MAX_FREQUENCY;
+	const int side = 2 * F + 1;
+	double * real = TRACKED_NEW(MEMORY_SCRATCH, double, side * side);
+	double * imag = TRACKED_NEW(MEMORY_SCRATCH, double, side * side);
+	memset(real, 0, side * side * sizeof(double));
+	memset(imag, 0, side * side * sizeof(double));
+	for(uint i = 0; i < n; ++i)
+	{
+		double ex[2 * SAMPLE_SPECTRUM_MAX_FREQUENCY + 1][2];
+		double ey[2 * SAMPLE_SPECTRUM_MAX_FREQUENCY + 1][2];
+		for(int f = -F; f <= F; ++f)
+		{
+			ex[f + F][0] = cos(PI2 * f * points[2 * i]);
+			ex[f + F][1] = -sin(PI2 * f * points[2 * i]);
+			ey[f + F][0] = cos(PI2 * f * points[2 * i + 1]);
+			ey[f + F][1] = -sin(PI2 * f * points[2 * i + 1]);
+		}
+		for(int fy = 0; fy < side; ++fy)
+		{
+			for(int fx = 0; fx < side; ++fx)
+			{
+				real[fy * side + fx] += ex[fx][0] * ey[fy][0] - ex[fx][1] * ey[fy][1];
+				imag[fy * side + fx] += ex[fx][0] * ey[fy][1] + ex[fx][1] * ey[fy][0];
+			}
+		}
+	}
+	for(int fy = -F; fy <= F; ++fy)
+	{
+		for(int fx = -F; fx <= F; ++fx)
+		{
+			int bin = (int)(sqrt((double)(fx * fx + fy * fy)) + 0.5);
+			if(bin == 0 || bin > F)
+			{
+				continue;
+			}
+			int index = (fy + F) * side + fx + F;
+			spectrum[bin] += (real[index] * real[index] + imag[index] * imag[index]) / n;
+			binCounts[bin]++;
+		}
+	}
+	TRACKED_DELETE(MEMORY_SCRATCH, real, side * side);
+	TRACKED_DELETE(MEMORY_SCRATCH, imag, side * side);
+}
+
+/* Analysis */
+
+struct SampleIntegrandStats
+{
+	SampleIntegrand * integrand;
+	double rmse[SAMPLE_STATS_COUNT_COUNT];
+	double slope;
+};
+
+struct SampleGeneratorStats
+{
+	uint sampleCounts[SAMPLE_STATS_COUNT_COUNT]; // what the generator gave for each requested count
+	double starDiscrepancy[SAMPLE_STATS_COUNT_COUNT]; // 2D domains only
+	double l2StarDiscrepancy[SAMPLE_STATS_COUNT_COUNT];
+	double spectrum[SAMPLE_SPECTRUM_MAX_FREQUENCY + 1]; // 2D domains only
+	double lowFrequencyPower; // mean of the spectrum below half of sqrt(n)
+	int integrandCount;
+	SampleIntegrandStats integrands[sizeof(sampleIntegrands)/sizeof(sampleIntegrands[0])];
+};
+
+// least squares slope of log y over log x, skipping zeros
+double GetLogLogSlope(uint * x, double * y, int count)
+{
+	double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+	int n = 0;
+	for(int i = 0; i < count; ++i)
+	{
+		if(y[i] > 0.0)
+		{
+			double lx = log((double)x[i]);
+			double ly = log(y[i]);
+			sx += lx;
+			sy += ly;
+			sxx += lx * lx;
+			sxy += lx * ly;
+			n++;
+		}
+	}
+	double denominator = n * sxx - sx * sx;
+	return n >= 2 && denominator != 0.0 ? (n * sxy - sx * sy) / denominator : 0.0;
+}
+
+void AnalyzeSampleGenerator(SampleGeneratorInfo * generator, uint32 seed, SampleGeneratorStats * stats)
+{
+	*stats = {};
+	int d = sampleDomainDimensions[generator->domain];
+	double measure = sampleDomainMeasures[generator->domain];
+	V3 * samples = TRACKED_NEW(MEMORY_SCRATCH, V3, SAMPLE_STATS_MAX_COUNT);
+	double * points = TRACKED_NEW(MEMORY_SCRATCH, double, SAMPLE_STATS_MAX_COUNT * 3);
+	double * scratch = TRACKED_NEW(MEMORY_SCRATCH, double, SAMPLE_STATS_MAX_COUNT * 4 + 4);
+	uint * counts = TRACKED_NEW(MEMORY_SCRATCH, uint, SAMPLE_STATS_MAX_COUNT + 1);
+
+	for(int i = 0; i < sizeof(sampleIntegrands)/sizeof(sampleIntegrands[0]); ++i)
+	{
+		if(sampleIntegrands[i].domain == generator->domain)
+		{
+			stats->integrands[stats->integrandCount++].integrand = &sampleIntegrands[i];
+		}
+	}
+
+	// the generators draw from the calling thread's RNG
+	RNG * rng = &gPerThreadRng[LOCAL_THREAD_ID];
+	for(int c = 0; c < SAMPLE_STATS_COUNT_COUNT; ++c)
+	{
+		for(int trial = 0; trial < SAMPLE_STATS_TRIALS; ++trial)
+		{
+			*rng = RNG(seed + trial * 7919 + c);
+			uint n = generator->generate(sampleStatsCounts[c], samples);
+			stats->sampleCounts[c] = n;
+			for(uint i = 0; i < n; ++i)
+			{
+				double u[3] = {};
+				GetUnitCoordinates(samples[i], generator->domain, u);
+				memcpy(points + i * d, u, d * sizeof(double));
+			}
+
+			if(d == 2)
+			{
+				stats->starDiscrepancy[c] += GetStarDiscrepancy2D(points, n, scratch, counts) / SAMPLE_STATS_TRIALS;
+			}
+			stats->l2StarDiscrepancy[c] += GetL2StarDiscrepancy(points, n, d) / SAMPLE_STATS_TRIALS;
+			if(d == 2 && sampleStatsCounts[c] == SAMPLE_SPECTRUM_COUNT && trial < SAMPLE_SPECTRUM_TRIALS)
+			{
+				uint binCounts[SAMPLE_SPECTRUM_MAX_FREQUENCY + 1] = {};
+				double spectrum[SAMPLE_SPECTRUM_MAX_FREQUENCY + 1] = {};
+				AddRadialSpectrum(points, n, spectrum, binCounts);
+				for(int f = 1; f <= SAMPLE_SPECTRUM_MAX_FREQUENCY; ++f)
+				{
+					stats->spectrum[f] += spectrum[f] / binCounts[f] / SAMPLE_SPECTRUM_TRIALS;
+				}
+			}
+
+			for(int k = 0; k < stats->integrandCount; ++k)
+			{
+				SampleIntegrandStats * integrandStats = &stats->integrands[k];
+				double sum = 0.0;
+				for(uint i = 0; i < n; ++i)
+				{
+					sum += integrandStats->integrand->f(samples[i]);
+				}
+				double error = sum * measure / n - integrandStats->integrand->exact;
+				integrandStats->rmse[c] += error * error / SAMPLE_STATS_TRIALS;
+			}
+		}
+	}
+
+	for(int k = 0; k < stats->integrandCount; ++k)
+	{
+		SampleIntegrandStats * integrandStats = &stats->integrands[k];
+		for(int c = 0; c < SAMPLE_STATS_COUNT_COUNT; ++c)
+		{
+			integrandStats->rmse[c] = sqrt(integrandStats->rmse[c]);
+		}
+		integrandStats->slope = GetLogLogSlope(stats->sampleCounts, integrandStats->rmse, SAMPLE_STATS_COUNT_COUNT);
+	}
+
+	if(d == 2)
+	{
+		int lowCount = 0;
+		for(int f = 1; f < sqrt((double)SAMPLE_SPECTRUM_COUNT) * 0.5; ++f)
+		{
+			stats->lowFrequencyPower += stats->spectrum[f];
+			lowCount++;
+		}
+		stats->lowFrequencyPower /= lowCount;
+	}
+
+	TRACKED_DELETE(MEMORY_SCRATCH, samples, SAMPLE_STATS_MAX_COUNT);
+	TRACKED_DELETE(MEMORY_SCRATCH, points, SAMPLE_STATS_MAX_COUNT * 3);
+	TRACKED_DELETE(MEMORY_SCRATCH, scratch, SAMPLE_STATS_MAX_COUNT * 4 + 4);
+	TRACKED_DELETE(MEMORY_SCRATCH, counts, SAMPLE_STATS_MAX_COUNT + 1);
+}
+
+void WriteDoubleArray(FILE * file, double * values, int count, const char * format)
+{
+	fprintf(file, "[");
+	for(int i = 0; i < count; ++i)
+	{
+		fprintf(file, "%s", i ? ", " : "");
+		fprintf(file, format, values[i]);
+	}
+	fprintf(file, "]");
+}
+
+// generatorName null analyzes all of them
+void RunSampleStats(FILE * file, const char * generatorName)
+{
+	fprintf(file, "\"trials\": %d, \"samplers\": [\n", SAMPLE_STATS_TRIALS);
+	bool first = true;
+	for(int i = 0; i < sizeof(sampleGenerators)/sizeof(sampleGenerators[0]); ++i)
+	{
+		SampleGeneratorInfo * generator = &sampleGenerators[i];
+		if(generatorName && strcmp(generatorName, generator->name) != 0)
+		{
+			continue;
+		}
+		SampleGeneratorStats stats;
+		AnalyzeSampleGenerator(generator, BENCH_SEED, &stats);
+		bool planar = sampleDomainDimensions[generator->domain] == 2;
+
+		fprintf(file, "%s    {\"name\": \"%s\", \"domain\": \"%s\", \"counts\": [", first ? "" : ",\n", generator->name, sampleDomainNames[generator->domain]);
+		for(int c = 0; c < SAMPLE_STATS_COUNT_COUNT; ++c)
+		{
+			fprintf(file, "%s%u", c ? ", " : "", stats.sampleCounts[c]);
+		}
+		fprintf(file, "],\n     \"starDiscrepancy\": ");
+		if(planar)
+			WriteDoubleArray(file, stats.starDiscrepancy, SAMPLE_STATS_COUNT_COUNT, "%.5f");
+		else
+			fprintf(file, "null");
+		fprintf(file, ", \"l2StarDiscrepancy\": ");
+		WriteDoubleArray(file, stats.l2StarDiscrepancy, SAMPLE_STATS_COUNT_COUNT, "%.5f");
+		if(planar)
+		{
+			fprintf(file, ",\n     \"spectrumCount\": %d, \"lowFrequencyPower\": %.4f, \"radialSpectrum\": ", SAMPLE_SPECTRUM_COUNT, stats.lowFrequencyPower);
+			WriteDoubleArray(file, stats.spectrum + 1, SAMPLE_SPECTRUM_MAX_FREQUENCY, "%.3f");
+		}
+		fprintf(file, ",\n     \"integrands\": [");
+		for(int k = 0; k < stats.integrandCount; ++k)
+		{
+			SampleIntegrandStats * integrandStats = &stats.integrands[k];
+			fprintf(file, "%s{\"name\": \"%s\", \"exact\": %.6f, \"slope\": %.3f, \"rmse\": ", k ? ",\n                     " : "",
+					integrandStats->integrand->name, integrandStats->integrand->exact, integrandStats->slope);
+			WriteDoubleArray(file, integrandStats->rmse, SAMPLE_STATS_COUNT_COUNT, "%.4g");
+			fprintf(file, "}");
+		}
+		fprintf(file, "]}");
+		first = false;
+
+		uint last = SAMPLE_STATS_COUNT_COUNT - 1;
+		fprintf(stderr, "%-34s %-11s %s(%u) %.4f", generator->name, sampleDomainNames[generator->domain], planar ? "D*" : "L2",
+				stats.sampleCounts[last], planar ? stats.starDiscrepancy[last] : stats.l2StarDiscrepancy[last]);
+		for(int k = 0; k < stats.integrandCount; ++k)
+		{
+			fprintf(stderr, " %s %.2f", stats.integrands[k].integrand->name, stats.integrands[k].slope);
+		}
+		fprintf(stderr, "\n");
+	}
+	fprintf(file, "\n]");
+}
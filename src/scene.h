@@ -16,35 +16,305 @@ struct Material
 	bool isConductor;
 };
 
-struct Object
-{
-	Geometry geometry;
-	Material material;
-};
-
+// Everything is stored as parallel arrays, one arena each so every array stays contiguous
+// however large the scene gets. Primitives are kept apart by type so intersection runs one
+// tight loop per type over a range of them: spheres as columns of floats, planes and meshes
+// as arrays of their structs. A primitive is its type and its index in the arrays of that
+// type, each type maps its primitives to their objects. The objects hold what is only read
+// for the closest hit, the materials.
 struct Scene
 {
-	Object objects[32];
-	Light lights[32];
-	unsigned int objectCount;
-	unsigned int lightCount;
+	float * sphereX;
+	float * sphereY;
+	float * sphereZ;
+	float * sphereRadius;
+	Plane * planes;
+	Mesh * meshes;
+	uint * sphereObjects;
+	uint * planeObjects;
+	uint * meshObjects;
+	uint sphereCount;
+	uint planeCount;
+	uint meshCount;
+
+	Material * materials;
+	Light * lights;
+	uint objectCount;
+	uint lightCount;
+
+	Arena sphereXArena;
+	Arena sphereYArena;
+	Arena sphereZArena;
+	Arena sphereRadiusArena;
+	Arena planeArena;
+	Arena meshArena;
+	Arena sphereObjectArena;
+	Arena planeObjectArena;
+	Arena meshObjectArena;
+	Arena materialArena;
+	Arena lightArena;
+	Arena positionArena; // mesh data, meshes point into these
+	Arena normalArena;
+	Arena indexArena;
 };
 
-Vertex * vb;
 Scene scene = Scene();
 
-void InitScene()
+// The most a scene can hold, each array reserves room for its limit. About 4GB of address
+// space per scene, committed only as it fills.
+#define SCENE_MAX_SPHERES (1u << 24)
+#define SCENE_MAX_PLANES (1u << 12)
+#define SCENE_MAX_MESHES (1u << 20)
+#define SCENE_MAX_OBJECTS (SCENE_MAX_SPHERES + SCENE_MAX_PLANES + SCENE_MAX_MESHES)
+#define SCENE_MAX_LIGHTS (1u << 16)
+#define SCENE_MAX_MESH_VERTICES (1u << 26) // all meshes together
+#define SCENE_MAX_MESH_TRIANGLES (1u << 26)
+
+bool InitSceneStorage(Scene * s)
+{
+	*s = Scene();
+	if(!InitArena(&s->sphereXArena, MEMORY_GEOMETRY, SCENE_MAX_SPHERES * sizeof(float)) ||
+	   !InitArena(&s->sphereYArena, MEMORY_GEOMETRY, SCENE_MAX_SPHERES * sizeof(float)) ||
+	   !InitArena(&s->sphereZArena, MEMORY_GEOMETRY, SCENE_MAX_SPHERES * sizeof(float)) ||
+	   !InitArena(&s->sphereRadiusArena, MEMORY_GEOMETRY, SCENE_MAX_SPHERES * sizeof(float)) ||
+	   !InitArena(&s->planeArena, MEMORY_GEOMETRY, SCENE_MAX_PLANES * sizeof(Plane)) ||
+	   !InitArena(&s->meshArena, MEMORY_GEOMETRY, SCENE_MAX_MESHES * sizeof(Mesh)) ||
+	   !InitArena(&s->sphereObjectArena, MEMORY_GEOMETRY, SCENE_MAX_SPHERES * sizeof(uint)) ||
+	   !InitArena(&s->planeObjectArena, MEMORY_GEOMETRY, SCENE_MAX_PLANES * sizeof(uint)) ||
+	   !InitArena(&s->meshObjectArena, MEMORY_GEOMETRY, SCENE_MAX_MESHES * sizeof(uint)) ||
+	   !InitArena(&s->materialArena, MEMORY_GEOMETRY, SCENE_MAX_OBJECTS * sizeof(Material)) ||
+	   !InitArena(&s->lightArena, MEMORY_GEOMETRY, SCENE_MAX_LIGHTS * sizeof(Light)) ||
+	   !InitArena(&s->positionArena, MEMORY_GEOMETRY, SCENE_MAX_MESH_VERTICES * sizeof(V3)) ||
+	   !InitArena(&s->normalArena, MEMORY_GEOMETRY, SCENE_MAX_MESH_VERTICES * sizeof(V3)) ||
+	   !InitArena(&s->indexArena, MEMORY_GEOMETRY, 3 * (size_t)SCENE_MAX_MESH_TRIANGLES * sizeof(uint32)))
+	{
+		return false;
+	}
+	s->sphereX = (float*)s->sphereXArena.base;
+	s->sphereY = (float*)s->sphereYArena.base;
+	s->sphereZ = (float*)s->sphereZArena.base;
+	s->sphereRadius = (float*)s->sphereRadiusArena.base;
+	s->planes = (Plane*)s->planeArena.base;
+	s->meshes = (Mesh*)s->meshArena.base;
+	s->sphereObjects = (uint*)s->sphereObjectArena.base;
+	s->planeObjects = (uint*)s->planeObjectArena.base;
+	s->meshObjects = (uint*)s->meshObjectArena.base;
+	s->materials = (Material*)s->materialArena.base;
+	s->lights = (Light*)s->lightArena.base;
+	return true;
+}
+
+void FreeScene(Scene * s)
+{
+	FreeArena(&s->sphereXArena);
+	FreeArena(&s->sphereYArena);
+	FreeArena(&s->sphereZArena);
+	FreeArena(&s->sphereRadiusArena);
+	FreeArena(&s->planeArena);
+	FreeArena(&s->meshArena);
+	FreeArena(&s->sphereObjectArena);
+	FreeArena(&s->planeObjectArena);
+	FreeArena(&s->meshObjectArena);
+	FreeArena(&s->materialArena);
+	FreeArena(&s->lightArena);
+	FreeArena(&s->positionArena);
+	FreeArena(&s->normalArena);
+	FreeArena(&s->indexArena);
+	*s = Scene();
+}
+
+// the object for a primitive already pushed, returns the object index or ~0u when the
+// scene is out of address space
+uint AddObject(Scene * s, Material material)
+{
+	Material * m = PUSH_STRUCT(&s->materialArena, Material);
+	if(!m)
+	{
+		return ~0u;
+	}
+	*m = material;
+	return s->objectCount++;
+}
+
+uint AddSphere(Scene * s, V3 center, float radius, Material material)
+{
+	float * x = PUSH_STRUCT(&s->sphereXArena, float);
+	float * y = PUSH_STRUCT(&s->sphereYArena, float);
+	float * z = PUSH_STRUCT(&s->sphereZArena, float);
+	float * r = PUSH_STRUCT(&s->sphereRadiusArena, float);
+	uint * object = PUSH_STRUCT(&s->sphereObjectArena, uint);
+	if(!x || !y || !z || !r || !object)
+	{
+		return ~0u;
+	}
+	*x = center.x;
+	*y = center.y;
+	*z = center.z;
+	*r = radius;
+	*object = s->objectCount;
+	s->sphereCount++;
+	return AddObject(s, material);
+}
+
+uint AddPlane(Scene * s, V3 point, V3 normal, Material material)
+{
+	Plane * plane = PUSH_STRUCT(&s->planeArena, Plane);
+	uint * object = PUSH_STRUCT(&s->planeObjectArena, uint);
+	if(!plane || !object)
+	{
+		return ~0u;
+	}
+	plane->p = point;
+	plane->n = normal;
+	*object = s->objectCount;
+	s->planeCount++;
+	return AddObject(s, material);
+}
+
+// Room for an indexed mesh in the scene, zeroed. Fill in the positions, SetMeshNormal and
+// SetMeshTriangle, then AddMesh.
+bool PushMesh(Scene * s, Mesh * mesh, uint vertexCount, uint triangleCount, bool octNormals)
+{
+	*mesh = {};
+	mesh->vertexCount = vertexCount;
+	mesh->triangleCount = triangleCount;
+	mesh->shortIndices = vertexCount <= 0x10000;
+	mesh->octNormals = octNormals;
+	mesh->positions = PUSH_ARRAY(&s->positionArena, V3, vertexCount);
+	if(octNormals)
+	{
+		mesh->normals = PUSH_ARRAY(&s->normalArena, uint32, vertexCount);
+	}
+	else
+	{
+		mesh->normals = PUSH_ARRAY(&s->normalArena, V3, vertexCount);
+	}
+	if(mesh->shortIndices)
+	{
+		mesh->indices = PUSH_ARRAY(&s->indexArena, uint16, 3 * triangleCount);
+	}
+	else
+	{
+		mesh->indices = PUSH_ARRAY(&s->indexArena, uint32, 3 * triangleCount);
+	}
+	return mesh->positions && mesh->normals && mesh->indices;
+}
+
+// a mesh filled in after PushMesh
+uint AddMesh(Scene * s, Mesh * filled, Material material)
+{
+	Mesh * mesh = PUSH_STRUCT(&s->meshArena, Mesh);
+	uint * object = PUSH_STRUCT(&s->meshObjectArena, uint);
+	if(!mesh || !object)
+	{
+		return ~0u;
+	}
+	*mesh = *filled;
+	ComputeMeshBound(mesh);
+	*object = s->objectCount;
+	s->meshCount++;
+	return AddObject(s, material);
+}
+
+inline uint32 HashVertex(Vertex * v)
 {
-	scene.lights[scene.lightCount].position = {0.0f, 0.0f, 5.0f};
-	scene.lights[scene.lightCount].color = {0.8f, 0.6f, 0.5f, 1.0f};
-	scene.lights[scene.lightCount].intensity = 30.0f;
-	scene.lights[scene.lightCount].intensity = 60.0f * 17.5f / (PI*4.0f);
-	// scene.lightCount++;
+	// FNV-1a over the bits, equal vertices are bitwise equal
+	uint32 * words = (uint32*)v;
+	uint32 hash = 2166136261u;
+	for(int i = 0; i < (int)(sizeof(Vertex) / sizeof(uint32)); ++i)
+	{
+		hash = (hash ^ words[i]) * 16777619u;
+	}
+	return hash;
+}
 
-	scene.lights[scene.lightCount].position = {2.5f, 0.0f, 1.5f};
-	scene.lights[scene.lightCount].color = {0.4f, 0.6f, 0.8f, 1.0f};
-	scene.lights[scene.lightCount].intensity = 20.0f * 17.5f / (PI*4.0f);
-	// scene.lightCount++;
+// Three vertices per triangle, indexed on the way in: vertices with the same position and
+// normal are stored once. The vertices are only read, they can live anywhere.
+uint AddMesh(Scene * s, Vertex * vertices, uint vertexCount, Material material, bool octNormals = false)
+{
+	TRACE_SCOPE("AddMesh");
+	// open addressing, the table holds the first input vertex of every unique one
+	uint tableSize = 16;
+	while(tableSize < 2 * vertexCount)
+	{
+		tableSize *= 2;
+	}
+	uint * table = TRACKED_NEW(MEMORY_SCRATCH, uint, tableSize);
+	uint * remap = TRACKED_NEW(MEMORY_SCRATCH, uint, vertexCount);
+	uint * unique = TRACKED_NEW(MEMORY_SCRATCH, uint, vertexCount);
+	memset(table, 0xFF, tableSize * sizeof(uint));
+
+	uint uniqueCount = 0;
+	for(uint i = 0; i < vertexCount; ++i)
+	{
+		uint slot = HashVertex(&vertices[i]) & (tableSize - 1);
+		while(table[slot] != ~0u && memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if(table[slot] == ~0u)
+		{
+			table[slot] = i;
+			remap[i] = uniqueCount;
+			unique[uniqueCount++] = i;
+		}
+		else
+		{
+			remap[i] = remap[table[slot]];
+		}
+	}
+
+	uint result = ~0u;
+	Mesh mesh;
+	if(PushMesh(s, &mesh, uniqueCount, vertexCount / 3, octNormals))
+	{
+		for(uint i = 0; i < uniqueCount; ++i)
+		{
+			mesh.positions[i] = vertices[unique[i]].position;
+			SetMeshNormal(&mesh, i, vertices[unique[i]].normal);
+		}
+		for(uint i = 0; i < mesh.triangleCount; ++i)
+		{
+			SetMeshTriangle(&mesh, i, remap[3*i + 0], remap[3*i + 1], remap[3*i + 2]);
+		}
+		result = AddMesh(s, &mesh, material);
+	}
+
+	TRACKED_DELETE(MEMORY_SCRATCH, table, tableSize);
+	TRACKED_DELETE(MEMORY_SCRATCH, remap, vertexCount);
+	TRACKED_DELETE(MEMORY_SCRATCH, unique, vertexCount);
+	return result;
+}
+
+Light * AddLight(Scene * s)
+{
+	Light * light = PUSH_STRUCT(&s->lightArena, Light);
+	if(light)
+	{
+		s->lightCount++;
+	}
+	return light;
+}
+
+bool InitScene(Scene * s)
+{
+	TRACE_SCOPE("InitScene");
+	if(!InitSceneStorage(s))
+	{
+		return false;
+	}
+	Light light0 = {};
+	light0.position = {0.0f, 0.0f, 5.0f};
+	light0.color = {0.8f, 0.6f, 0.5f, 1.0f};
+	light0.intensity = 30.0f;
+	light0.intensity = 60.0f * 17.5f / (PI*4.0f);
+	// *AddLight(s) = light0;
+
+	Light light1 = {};
+	light1.position = {2.5f, 0.0f, 1.5f};
+	light1.color = {0.4f, 0.6f, 0.8f, 1.0f};
+	light1.intensity = 20.0f * 17.5f / (PI*4.0f);
+	// *AddLight(s) = light1;
 
 	Material matBase = {};
 	matBase.diffuse = {0.8f, 0.8f, 0.8f, 1.0f};
@@ -87,123 +357,76 @@ void InitScene()
 	matTop.diffuse = V4{0.0f, 0.0f, 1.0f, 1.0f};
 #endif
 
-	vb = new Vertex[256];
+	Vertex vb[36] = {};
 
 	// sphere
-	scene.objects[scene.objectCount].geometry.type = GeoType::SPHERE;
-	scene.objects[scene.objectCount].geometry.sphere.o = {1.0f, 0.8f, 1.0f};
-	scene.objects[scene.objectCount].geometry.sphere.r = 1.0f;
-	scene.objects[scene.objectCount].material = matGold;
-	scene.objectCount++;
+	AddSphere(s, {1.0f, 0.8f, 1.0f}, 1.0f, matGold);
 
 #if 1
-	scene.objects[scene.objectCount].geometry.type = GeoType::SPHERE;
-	scene.objects[scene.objectCount].geometry.sphere.o = {0.0f, -1.0f, 1.0f};
-	scene.objects[scene.objectCount].geometry.sphere.r = 1.0f;
-	scene.objects[scene.objectCount].material = matBase;
-	scene.objectCount++;
+	AddSphere(s, {0.0f, -1.0f, 1.0f}, 1.0f, matBase);
 #endif
 
 	#if 1
-	scene.objects[scene.objectCount].geometry.type = GeoType::SPHERE;
-	scene.objects[scene.objectCount].geometry.sphere.o = {0, 2.1f, 0.5f};
-	scene.objects[scene.objectCount].geometry.sphere.r = 0.5f;
-	scene.objects[scene.objectCount].material = matCopper;
-	scene.objects[scene.objectCount].material = matEmissive;
-	scene.objectCount++;
+	// AddSphere(s, {0, 2.1f, 0.5f}, 0.5f, matCopper);
+	AddSphere(s, {0, 2.1f, 0.5f}, 0.5f, matEmissive);
 #endif
 
 	// right
-	scene.objects[scene.objectCount].geometry.type = GeoType::MESH;
 	vb[0] = {{ 3.0f,  3.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
 	vb[1] = {{-3.0f,  3.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
 	vb[2] = {{-3.0f,  3.0f, 6.0f}, {0.0f, -1.0f, 0.0f}};
 	vb[3] = {{ 3.0f,  3.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
 	vb[4] = {{-3.0f,  3.0f, 6.0f}, {0.0f, -1.0f, 0.0f}};
 	vb[5] = {{ 3.0f,  3.0f, 6.0f}, {0.0f, -1.0f, 0.0f}};
-
-	scene.objects[scene.objectCount].geometry.mesh.vertexCount = 6;
-	scene.objects[scene.objectCount].geometry.mesh.vertices = vb;
-	scene.objects[scene.objectCount].material = matRight;
-	ComputeMeshBound(&scene.objects[scene.objectCount].geometry.mesh);
-	scene.objectCount++;
+	AddMesh(s, vb, 6, matRight);
 
 
 	// left
-	scene.objects[scene.objectCount].geometry.type = GeoType::MESH;
 	vb[6] =  {{ 3.0f, -3.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
 	vb[7] =  {{-3.0f, -3.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
 	vb[8] =  {{-3.0f, -3.0f, 6.0f}, {0.0f, 1.0f, 0.0f}};
 	vb[9] =  {{ 3.0f, -3.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
 	vb[10] = {{-3.0f, -3.0f, 6.0f}, {0.0f, 1.0f, 0.0f}};
 	vb[11] = {{ 3.0f, -3.0f, 6.0f}, {0.0f, 1.0f, 0.0f}};
-
-	scene.objects[scene.objectCount].geometry.mesh.vertexCount = 6;
-	scene.objects[scene.objectCount].geometry.mesh.vertices = vb + 6;
-	scene.objects[scene.objectCount].material = matLeft;
-	ComputeMeshBound(&scene.objects[scene.objectCount].geometry.mesh);
-	scene.objectCount++;
+	AddMesh(s, vb + 6, 6, matLeft);
 
 	// back
-	scene.objects[scene.objectCount].geometry.type = GeoType::MESH;
 	vb[12] = {{ 3.0f, -3.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}};
 	vb[13] = {{ 3.0f,  3.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}};
 	vb[14] = {{ 3.0f,  3.0f, 6.0f}, {-1.0f, 0.0f, 0.0f}};
 	vb[15] = {{ 3.0f, -3.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}};
 	vb[16] = {{ 3.0f,  3.0f, 6.0f}, {-1.0f, 0.0f, 0.0f}};
 	vb[17] = {{ 3.0f, -3.0f, 6.0f}, {-1.0f, 0.0f, 0.0f}};
-
-	scene.objects[scene.objectCount].geometry.mesh.vertexCount = 6;
-	scene.objects[scene.objectCount].geometry.mesh.vertices = vb + 12;
-	scene.objects[scene.objectCount].material = matBack;
-	ComputeMeshBound(&scene.objects[scene.objectCount].geometry.mesh);
-	scene.objectCount++;
+	AddMesh(s, vb + 12, 6, matBack);
 
 #if 1
 	// bottom
-	scene.objects[scene.objectCount].geometry.type = GeoType::MESH;
 	vb[18] = {{ 3.0f, -3.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
 	vb[19] = {{-3.0f, -3.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
 	vb[20] = {{-3.0f,  3.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
 	vb[21] = {{ 3.0f, -3.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
 	vb[22] = {{-3.0f,  3.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
 	vb[23] = {{ 3.0f,  3.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
-
-	scene.objects[scene.objectCount].geometry.mesh.vertexCount = 6;
-	scene.objects[scene.objectCount].geometry.mesh.vertices = vb + 18;
-	scene.objects[scene.objectCount].material = matBottom;
-	ComputeMeshBound(&scene.objects[scene.objectCount].geometry.mesh);
-	scene.objectCount++;
+	AddMesh(s, vb + 18, 6, matBottom);
 
 	// top
 #if 1
-	scene.objects[scene.objectCount].geometry.type = GeoType::MESH;
 	vb[24] = {{ 3.0f, -3.0f, 6.0f}, {0.0f, 0.0f, -1.0f}};
 	vb[25] = {{-3.0f,  3.0f, 6.0f}, {0.0f, 0.0f, -1.0f}};
 	vb[26] = {{-3.0f, -3.0f, 6.0f}, {0.0f, 0.0f, -1.0f}};
 	vb[27] = {{ 3.0f, -3.0f, 6.0f}, {0.0f, 0.0f, -1.0f}};
 	vb[28] = {{ 3.0f,  3.0f, 6.0f}, {0.0f, 0.0f, -1.0f}};
 	vb[29] = {{-3.0f,  3.0f, 6.0f}, {0.0f, 0.0f, -1.0f}};
-
-	scene.objects[scene.objectCount].geometry.mesh.vertexCount = 6;
-	scene.objects[scene.objectCount].geometry.mesh.vertices = vb + 24;
-	scene.objects[scene.objectCount].material = matTop;
-	ComputeMeshBound(&scene.objects[scene.objectCount].geometry.mesh);
-	scene.objectCount++;
+	AddMesh(s, vb + 24, 6, matTop);
 #endif
 
-	scene.objects[scene.objectCount].geometry.type = GeoType::MESH;
 	vb[30] = {{ 0.5f, -0.5f, 5.9f}, {0.0f, 0.0f, -1.0f}};
 	vb[31] = {{-0.5f,  0.5f, 5.9f}, {0.0f, 0.0f, -1.0f}};
 	vb[32] = {{-0.5f, -0.5f, 5.9f}, {0.0f, 0.0f, -1.0f}};
 	vb[33] = {{ 0.5f, -0.5f, 5.9f}, {0.0f, 0.0f, -1.0f}};
 	vb[34] = {{ 0.5f,  0.5f, 5.9f}, {0.0f, 0.0f, -1.0f}};
 	vb[35] = {{-0.5f,  0.5f, 5.9f}, {0.0f, 0.0f, -1.0f}};
-
-	scene.objects[scene.objectCount].geometry.mesh.vertexCount = 6;
-	scene.objects[scene.objectCount].geometry.mesh.vertices = vb + 30;
-	scene.objects[scene.objectCount].material = matEmissive;
-	ComputeMeshBound(&scene.objects[scene.objectCount].geometry.mesh);
-	scene.objectCount++;
+	AddMesh(s, vb + 30, 6, matEmissive);
 #endif
+	return true;
 }
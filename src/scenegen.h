@@ -0,0 +1,281 @@
+#pragma once
+
+// Seeded procedural scenes for scale testing: spheres, triangle meshes and point lights
+// over a ground plane. The same parameters and seed always give the same scene, so a
+// generated scene can be rendered by the viewer, resumed from a checkpoint and compared
+// across benchmark runs.
+//
+// Objects go in a box of half size extent on the ground, either uniformly or around
+// gaussian clusters. With extent 0 the box grows with the cube root of the object count,
+// so the density, and with it the depth complexity per ray, stays about the same from
+// 10 to 10^7 objects. Lights go in the same box, lifted above the objects.
+
+inline bool IsGeneratedScene(SceneGenParams * params)
+{
+	return params->sphereCount > 0 || params->meshCount > 0;
+}
+
+float GetGeneratedSceneExtent(SceneGenParams * params)
+{
+	if(params->extent > 0)
+	{
+		return (float)params->extent;
+	}
+	return 2.0f + cbrtf((float)(params->sphereCount + params->meshCount));
+}
+
+MeshKind GetGeneratedMeshKind(SceneGenParams * params, int meshIndex)
+{
+	if(params->meshKind == MESH_KIND_MIXED)
+	{
+		return (MeshKind)(MESH_KIND_SPHERE + meshIndex % (MESH_KIND_COUNT - 1));
+	}
+	return (MeshKind)params->meshKind;
+}
+
+// tessellation that gets closest to the requested triangle count
+int GetTessellation(MeshKind kind, int triangles)
+{
+	switch(kind)
+	{
+		case MESH_KIND_SPHERE: return max((int)(sqrtf(triangles / 4.0f) + 0.5f), 2); // stacks, 2 slices each
+		case MESH_KIND_GRID: return max((int)(sqrtf(triangles / 2.0f) + 0.5f), 1); // quads per side
+		default: return triangles;
+	}
+}
+
+int GetGeneratedTriangleCount(MeshKind kind, int triangles)
+{
+	int n = GetTessellation(kind, triangles);
+	switch(kind)
+	{
+		case MESH_KIND_SPHERE: return 4 * n * n;
+		case MESH_KIND_GRID: return 2 * n * n;
+		default: return n;
+	}
+}
+
+int GetGeneratedVertexCount(MeshKind kind, int triangles)
+{
+	int n = GetTessellation(kind, triangles);
+	switch(kind)
+	{
+		case MESH_KIND_SPHERE: return (n + 1) * (2 * n + 1);
+		case MESH_KIND_GRID: return (n + 1) * (n + 1);
+		default: return 3 * n;
+	}
+}
+
+V3 RandomUnitVector(RNG * rng)
+{
+	while(true)
+	{
+		V3 v = {rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f)};
+		float ll = LengthSq(v);
+		if(ll > 0.0001f && ll <= 1.0f)
+		{
+			return v / sqrtf(ll);
+		}
+	}
+}
+
+float RandomNormal(RNG * rng)
+{
+	// Box-Muller
+	float u1 = rng->Next(1e-7f, 1.0f);
+	float u2 = rng->Next(0.0f, 1.0f);
+	return sqrtf(-2.0f * logf(u1)) * cosf(PI2 * u2);
+}
+
+V3 GenerateScenePosition(RNG * rng, V3 * clusters, int clusterCount, float clusterRadius, float extent)
+{
+	if(clusterCount > 0)
+	{
+		V3 center = clusters[(int)rng->Next(0.0f, (float)clusterCount) % clusterCount];
+		V3 p = center + V3{RandomNormal(rng), RandomNormal(rng), RandomNormal(rng)} * clusterRadius;
+		p.z = fmaxf(p.z, 0.0f);
+		return p;
+	}
+	return V3{rng->Next(-extent, extent), rng->Next(-extent, extent), rng->Next(0.0f, 2.0f * extent)};
+}
+
+Material GenerateMaterial(RNG * rng)
+{
+	Material mat = {};
+	mat.diffuse = {rng->Next(0.2f, 0.9f), rng->Next(0.2f, 0.9f), rng->Next(0.2f, 0.9f), 1.0f};
+	mat.rf0 = V4::FromFloat(0.005f);
+	return mat;
+}
+
+// The mesh builders fill a mesh from PushMesh with GetGeneratedVertexCount vertices and
+// GetGeneratedTriangleCount triangles.
+
+// (stacks + 1) * (slices + 1) vertices on a latitude-longitude grid, smooth shaded
+void GenerateSphereMesh(Mesh * mesh, V3 center, float radius, int stacks)
+{
+	int slices = stacks * 2;
+	for(int st = 0; st <= stacks; ++st)
+	{
+		for(int sl = 0; sl <= slices; ++sl)
+		{
+			float theta = PI * st / stacks;
+			float phi = PI2 * sl / slices;
+			V3 p = V3{sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta)};
+			uint vertex = st * (slices + 1) + sl;
+			mesh->positions[vertex] = center + p * radius;
+			SetMeshNormal(mesh, vertex, p);
+		}
+	}
+	uint triangle = 0;
+	for(int st = 0; st < stacks; ++st)
+	{
+		for(int sl = 0; sl < slices; ++sl)
+		{
+			uint v00 = st * (slices + 1) + sl;
+			uint v01 = v00 + 1;
+			uint v10 = v00 + slices + 1;
+			uint v11 = v10 + 1;
+			SetMeshTriangle(mesh, triangle++, v00, v10, v01);
+			SetMeshTriangle(mesh, triangle++, v01, v10, v11);
+		}
+	}
+}
+
+// triangles of up to a quarter of the mesh size, anywhere in a sphere around center
+void GenerateSoupMesh(Mesh * mesh, RNG * rng, V3 center, float radius, int triangles)
+{
+	float edge = radius * 0.5f;
+	for(int i = 0; i < triangles; ++i)
+	{
+		V3 p0 = center + V3{rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f)} * radius;
+		V3 p1 = p0 + V3{rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f)} * edge;
+		V3 p2 = p0 + V3{rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f), rng->Next(-1.0f, 1.0f)} * edge;
+		V3 n = Normalize(Cross(p1 - p0, p2 - p0));
+		mesh->positions[3*i + 0] = p0;
+		mesh->positions[3*i + 1] = p1;
+		mesh->positions[3*i + 2] = p2;
+		for(int c = 0; c < 3; ++c)
+		{
+			SetMeshNormal(mesh, 3*i + c, n);
+		}
+		SetMeshTriangle(mesh, i, 3*i + 0, 3*i + 1, 3*i + 2);
+	}
+}
+
+// a randomly oriented square of quadsPerSide^2 quads
+void GenerateGridMesh(Mesh * mesh, RNG * rng, V3 center, float radius, int quadsPerSide)
+{
+	V3 n = RandomUnitVector(rng);
+	V3 u, w;
+	OrthonormalBasisFromAxis(n, &u, &w);
+	float cell = 2.0f * radius / quadsPerSide;
+	V3 origin = center - (u + w) * radius;
+	int side = quadsPerSide + 1;
+	for(int y = 0; y < side; ++y)
+	{
+		for(int x = 0; x < side; ++x)
+		{
+			mesh->positions[y * side + x] = origin + u * (x * cell) + w * (y * cell);
+			SetMeshNormal(mesh, y * side + x, n);
+		}
+	}
+	uint triangle = 0;
+	for(int y = 0; y < quadsPerSide; ++y)
+	{
+		for(int x = 0; x < quadsPerSide; ++x)
+		{
+			uint v00 = y * side + x;
+			uint v10 = v00 + 1;
+			uint v01 = v00 + side;
+			uint v11 = v01 + 1;
+			SetMeshTriangle(mesh, triangle++, v00, v10, v11);
+			SetMeshTriangle(mesh, triangle++, v00, v11, v01);
+		}
+	}
+}
+
+// Fills s (uninitialized) with the scene and points cam at it, the caller frees it with FreeScene.
+bool GenerateScene(Scene * s, Camera * cam, SceneGenParams * params)
+{
+	TRACE_SCOPE("GenerateScene");
+	if(!InitSceneStorage(s))
+	{
+		return false;
+	}
+
+	RNG rng(params->seed);
+	float extent = GetGeneratedSceneExtent(params);
+	int objectCount = params->sphereCount + params->meshCount;
+	// about half the mean distance between objects
+	float size = extent / cbrtf((float)max(objectCount, 1));
+
+	V3 * clusters = nullptr;
+	float clusterRadius = 0.0f;
+	if(params->clusterCount > 0)
+	{
+		clusters = TRACKED_NEW(MEMORY_SCRATCH, V3, params->clusterCount);
+		for(int i = 0; i < params->clusterCount; ++i)
+		{
+			clusters[i] = GenerateScenePosition(&rng, nullptr, 0, 0.0f, extent);
+		}
+		clusterRadius = extent / cbrtf((float)params->clusterCount) * 0.5f;
+	}
+
+	Material groundMaterial = {};
+	groundMaterial.diffuse = {0.6f, 0.6f, 0.6f, 1.0f};
+	groundMaterial.rf0 = V4::FromFloat(0.005f);
+	// the adds fail once the scene is full (see SCENE_MAX_*), the scene is incomplete then
+	bool result = AddPlane(s, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, groundMaterial) != ~0u;
+
+	for(int i = 0; result && i < params->sphereCount; ++i)
+	{
+		float radius = size * rng.Next(0.3f, 0.7f);
+		V3 center = GenerateScenePosition(&rng, clusters, params->clusterCount, clusterRadius, extent);
+		result = AddSphere(s, center, radius, GenerateMaterial(&rng)) != ~0u;
+	}
+
+	for(int i = 0; result && i < params->meshCount; ++i)
+	{
+		MeshKind kind = GetGeneratedMeshKind(params, i);
+		int n = GetTessellation(kind, params->trianglesPerMesh);
+		V3 center = GenerateScenePosition(&rng, clusters, params->clusterCount, clusterRadius, extent);
+		float radius = size * rng.Next(0.3f, 0.7f);
+
+		Mesh mesh;
+		if(!PushMesh(s, &mesh, GetGeneratedVertexCount(kind, params->trianglesPerMesh),
+					 GetGeneratedTriangleCount(kind, params->trianglesPerMesh), params->octNormals != 0))
+		{
+			result = false;
+			break;
+		}
+		switch(kind)
+		{
+			case MESH_KIND_SPHERE: GenerateSphereMesh(&mesh, center, radius, n); break;
+			case MESH_KIND_GRID: GenerateGridMesh(&mesh, &rng, center, radius, n); break;
+			default: GenerateSoupMesh(&mesh, &rng, center, radius, n); break;
+		}
+		result = AddMesh(s, &mesh, GenerateMaterial(&rng)) != ~0u;
+	}
+
+	// about the same total light however many there are
+	for(int i = 0; result && i < params->lightCount; ++i)
+	{
+		Light * light = AddLight(s);
+		if(!light)
+		{
+			result = false;
+			break;
+		}
+		light->position = {rng.Next(-extent, extent), rng.Next(-extent, extent), rng.Next(2.0f * extent, 3.0f * extent)};
+		light->color = {rng.Next(0.6f, 1.0f), rng.Next(0.6f, 1.0f), rng.Next(0.6f, 1.0f), 1.0f};
+		light->intensity = 10.0f * extent * extent / params->lightCount;
+	}
+
+	if(clusters)
+	{
+		TRACKED_DELETE(MEMORY_SCRATCH, clusters, params->clusterCount);
+	}
+
+	*cam = LookAt(V3{-3.0f * extent, -1.0f * extent, 2.0f * extent}, V3{0.0f, 0.0f, 0.5f * extent}, 0.35f, 0.28f);
+	return result;
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+// WaitForMultipleObjects can't wait on more handles than this
+#define MAX_RENDER_THREAD_COUNT 64
+#define MAX_DIFFUSE_BOUNCES 8
+#define MAX_SECONDARY_RAYS (32*32)
+
+enum MeshKind
+{
+	MESH_KIND_MIXED, // cycles through the others
+	MESH_KIND_SPHERE, // tessellated sphere
+	MESH_KIND_SOUP, // random triangles
+	MESH_KIND_GRID, // flat grid of quads
+	MESH_KIND_COUNT
+};
+
+// procedural scene used instead of InitScene when any count is set, see scenegen.h
+struct SceneGenParams
+{
+	uint32 seed;
+	int32 sphereCount;
+	int32 meshCount;
+	int32 trianglesPerMesh; // rounded to what the mesh kind can tessellate
+	int32 meshKind;
+	int32 lightCount;
+	int32 clusterCount; // 0 places objects uniformly, otherwise in this many gaussian clusters
+	int32 extent; // half size of the volume the objects go in, 0 scales it with the object count
+	int32 octNormals; // 1 stores mesh normals octahedral encoded in 32 bits instead of 96
+};
+
+struct RenderSettings
+{
+	int width;
+	int height;
+	int samplesPerPixel;
+	int maxDiffuseBounces;
+	int secondaryRays;
+	int renderThreadCount;
+	const char * outputPath; // .exr or .pfm, null for no file output
+	const char * framebufferPath; // backing file for an out-of-core framebuffer, null to keep it in memory
+	const char * checkpointPath; // null for no checkpoints
+	bool resume; // continue the render stored in checkpointPath
+	int checkpointInterval; // seconds
+	const char * profileJsonPath; // call tree written here when the render finishes
+	const char * tracePath; // timeline of all threads written here when the render finishes
+	bool profileDisabled; // start with the coarse profile tier switched off, P toggles it
+	int metricsPort; // Prometheus endpoint on localhost, 0 for none
+	const char * heatmapPath; // per-pixel cycles and rays, .exr or .pfm, plus a false colour .bmp
+	SceneGenParams sceneGen;
+};
+
+const char * meshKindNames[MESH_KIND_COUNT] = {"mixed", "sphere", "soup", "grid"};
+
+RenderSettings DefaultRenderSettings()
+{
+	RenderSettings settings = {};
+	settings.width = 1280/2;
+	settings.height = 768/2;
+	settings.samplesPerPixel = 1;
+	settings.maxDiffuseBounces = 1;
+	settings.secondaryRays = 30*30;
+	settings.renderThreadCount = 8;
+	settings.checkpointInterval = 60;
+	settings.sceneGen.seed = 1;
+	settings.sceneGen.trianglesPerMesh = 1000;
+	return settings;
+}
+
+RenderSettings gSettings = DefaultRenderSettings();
+
+bool ParseIntArgument(int argc, char ** argv, int * i, int * out)
+{
+	if(*i + 1 >= argc)
+	{
+		return false;
+	}
+	char * end = nullptr;
+	long value = strtol(argv[*i + 1], &end, 10);
+	if(end == argv[*i + 1] || *end != 0)
+	{
+		return false;
+	}
+	*out = (int)value;
+	*i += 1;
+	return true;
+}
+
+bool ParseStringArgument(int argc, char ** argv, int * i, const char ** out)
+{
+	if(*i + 1 >= argc)
+	{
+		return false;
+	}
+	*out = argv[*i + 1];
+	*i += 1;
+	return true;
+}
+
+bool ParseMeshKindArgument(int argc, char ** argv, int * i, int32 * out)
+{
+	const char * name = nullptr;
+	if(!ParseStringArgument(argc, argv, i, &name))
+	{
+		return false;
+	}
+	for(int kind = 0; kind < MESH_KIND_COUNT; ++kind)
+	{
+		if(strcmp(name, meshKindNames[kind]) == 0)
+		{
+			*out = kind;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Recognized options:
+//   -width <px> -height <px> -spp <1|4> -bounces <n> -secondary <n> -threads <n>
+//   -out <path.exr|path.pfm> -framebuffer-file <path>
+//   -checkpoint <path> -checkpoint-interval <s> -resume <path>
+//   -profile-json <path> -trace <path.json> -heatmap <path.exr|path.pfm>
+//   -no-profile -metrics-port <port>
+//   -gen-spheres <n> -gen-meshes <n> -gen-mesh-triangles <n> -gen-mesh-kind <mixed|sphere|soup|grid>
+//   -gen-lights <n> -gen-clusters <n> -gen-extent <n> -gen-seed <n> -gen-oct-normals
+// Unknown options are left for the caller.
+bool ParseSettings(int argc, char ** argv, RenderSettings * settings)
+{
+	bool result = true;
+	for(int i = 1; i < argc && result; ++i)
+	{
+		char * arg = argv[i];
+		if(strcmp(arg, "-width") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->width);
+		else if(strcmp(arg, "-height") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->height);
+		else if(strcmp(arg, "-spp") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->samplesPerPixel);
+		else if(strcmp(arg, "-bounces") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->maxDiffuseBounces);
+		else if(strcmp(arg, "-secondary") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->secondaryRays);
+		else if(strcmp(arg, "-threads") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->renderThreadCount);
+		else if(strcmp(arg, "-out") == 0)
+			result = ParseStringArgument(argc, argv, &i, &settings->outputPath);
+		else if(strcmp(arg, "-framebuffer-file") == 0)
+			result = ParseStringArgument(argc, argv, &i, &settings->framebufferPath);
+		else if(strcmp(arg, "-checkpoint") == 0)
+			result = ParseStringArgument(argc, argv, &i, &settings->checkpointPath);
+		else if(strcmp(arg, "-checkpoint-interval") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->checkpointInterval);
+		else if(strcmp(arg, "-profile-json") == 0)
+			result = ParseStringArgument(argc, argv, &i, &settings->profileJsonPath);
+		else if(strcmp(arg, "-trace") == 0)
+			result = ParseStringArgument(argc, argv, &i, &settings->tracePath);
+		else if(strcmp(arg, "-no-profile") == 0)
+			settings->profileDisabled = true;
+		else if(strcmp(arg, "-metrics-port") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->metricsPort);
+		else if(strcmp(arg, "-heatmap") == 0)
+			result = ParseStringArgument(argc, argv, &i, &settings->heatmapPath);
+		else if(strcmp(arg, "-gen-spheres") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->sceneGen.sphereCount);
+		else if(strcmp(arg, "-gen-meshes") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->sceneGen.meshCount);
+		else if(strcmp(arg, "-gen-mesh-triangles") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->sceneGen.trianglesPerMesh);
+		else if(strcmp(arg, "-gen-mesh-kind") == 0)
+			result = ParseMeshKindArgument(argc, argv, &i, &settings->sceneGen.meshKind);
+		else if(strcmp(arg, "-gen-lights") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->sceneGen.lightCount);
+		else if(strcmp(arg, "-gen-clusters") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->sceneGen.clusterCount);
+		else if(strcmp(arg, "-gen-extent") == 0)
+			result = ParseIntArgument(argc, argv, &i, &settings->sceneGen.extent);
+		else if(strcmp(arg, "-gen-seed") == 0)
+			result = ParseIntArgument(argc, argv, &i, (int *)&settings->sceneGen.seed);
+		else if(strcmp(arg, "-gen-oct-normals") == 0)
+			settings->sceneGen.octNormals = 1;
+		else if(strcmp(arg, "-resume") == 0)
+		{
+			result = ParseStringArgument(argc, argv, &i, &settings->checkpointPath);
+			settings->resume = true;
+		}
+	}
+
+	if(settings->width <= 0 || settings->height <= 0)
+		result = false;
+	// NOTE: only the sample grids in render.h are supported
+	if(settings->samplesPerPixel != 1 && settings->samplesPerPixel != 4)
+		result = false;
+	if(settings->maxDiffuseBounces < 0 || settings->maxDiffuseBounces > MAX_DIFFUSE_BOUNCES)
+		result = false;
+	if(settings->secondaryRays < 1 || settings->secondaryRays > MAX_SECONDARY_RAYS)
+		result = false;
+	if(settings->renderThreadCount < 1 || settings->renderThreadCount > MAX_RENDER_THREAD_COUNT)
+		result = false;
+	if(settings->checkpointInterval < 1)
+		result = false;
+	if(settings->metricsPort < 0 || settings->metricsPort > 65535)
+		result = false;
+	SceneGenParams * gen = &settings->sceneGen;
+	if(gen->sphereCount < 0 || gen->meshCount < 0 || gen->lightCount < 0 || gen->clusterCount < 0 || gen->extent < 0)
+		result = false;
+	if(gen->trianglesPerMesh < 1)
+		result = false;
+
+	return result;
+}
@@ -1,31 +1,90 @@
 #pragma once
 
 
-#define MAX_RENDER_JOBS 20*12
+struct RenderJob;
+typedef void (*RenderKernel)(RenderJob * job);
 
 struct RenderJob
 {
 	Scene * scene;
 	Camera * camera;
 	int x0, x1, y0, y1;
-	V4 * bitmap;
+	int tileX, tileY;
+	Framebuffer * framebuffer;
+	ImageWriter * imageWriter;
+	Display * display;
 	int viewportWidth;
 	int viewportHeight;
 	int spp;
+	uint32 seed;
+	RenderKernel kernel;
+	Checkpoint * checkpoint;
+	Framebuffer * heatmap; // per-pixel cost, null when not recorded
 };
 
 struct JobQueue
 {
-	RenderJob jobs[MAX_RENDER_JOBS];
+	RenderJob * jobs = nullptr;
 	LONG jobCount = 0;
+	LONG jobCapacity = 0;
 
 	void Push(RenderJob job)
 	{
+		assert(jobCount < jobCapacity);
 		jobs[jobCount] = job;
 		jobCount++;
 	}
 };
 
+void InitJobQueue(JobQueue * queue, int capacity)
+{
+	queue->jobs = TRACKED_NEW(MEMORY_OTHER, RenderJob, capacity);
+	queue->jobCount = 0;
+	queue->jobCapacity = capacity;
+}
+
+void FreeJobQueue(JobQueue * queue)
+{
+	if(queue->jobs)
+	{
+		TRACKED_DELETE(MEMORY_OTHER, queue->jobs, queue->jobCapacity);
+	}
+	*queue = JobQueue();
+}
+
+// NOTE: jobs are popped from the back, so the tiles closest to the center go last in the array
+int CompareJobsByDistanceToCenter(const void * a, const void * b)
+{
+	const RenderJob * jobA = (const RenderJob *)a;
+	const RenderJob * jobB = (const RenderJob *)b;
+	V2 center = V2{jobA->viewportWidth/2.0f, jobA->viewportHeight/2.0f};
+	float scoreA = LengthSq(V2{(float)jobA->x0, (float)jobA->y0} - center);
+	float scoreB = LengthSq(V2{(float)jobB->x0, (float)jobB->y0} - center);
+	if(scoreA > scoreB) return -1;
+	if(scoreA < scoreB) return 1;
+	return 0;
+}
+
+void SortJobQueue(JobQueue * queue)
+{
+	qsort(queue->jobs, queue->jobCount, sizeof(RenderJob), CompareJobsByDistanceToCenter);
+}
+
+// fills in the pixel bounds and the seed of the job for one framebuffer tile,
+// the last row and column of tiles are clipped to the viewport
+void SetJobTile(RenderJob * job, int tileX, int tileY, int tileSize, int viewportWidth, int viewportHeight)
+{
+	job->tileX = tileX;
+	job->tileY = tileY;
+	job->viewportWidth = viewportWidth;
+	job->viewportHeight = viewportHeight;
+	job->x0 = tileX * tileSize;
+	job->x1 = min(job->x0 + tileSize, viewportWidth);
+	job->y0 = tileY * tileSize;
+	job->y1 = min(job->y0 + tileSize, viewportHeight);
+	job->seed = job->y0 * 11239 + job->x0;
+}
+
 struct AsyncTask
 {
 	int threadId;
@@ -35,14 +94,19 @@ struct AsyncTask
 
 // struct List
 
-void PerformRenderJob(RenderJob * job)
+template<int Spp, int MaxBounces, int SecondaryRays>
+void RenderTile(RenderJob * job)
 {
 PROFILED_FUNCTION;
+	TRACE_TILE_SCOPE("Tile", job->tileX, job->tileY);
+	const int spp = Spp == RUNTIME_PARAMETER ? job->spp : Spp;
+
 	uint tid = GetCurrentThreadId();
-	gPerThreadRng[LOCAL_THREAD_ID] = RNG(job->y0 * 11239 + job->x0);
+	gPerThreadRng[LOCAL_THREAD_ID] = RNG(job->seed);
 	float mpp = job->camera->filmWidth / job->viewportWidth;
 
-	V2i * pixels = new V2i[(job->y1 - job->y0) * (job->x1 - job->x0)];
+	int maxPixelCount = (job->y1 - job->y0) * (job->x1 - job->x0);
+	V2i * pixels = TRACKED_NEW(MEMORY_SCRATCH, V2i, maxPixelCount);
 	int pixelCount = 0;
 	for(int y = job->y0; y < job->y1; ++y)
 	{
@@ -61,16 +125,28 @@ PROFILED_FUNCTION;
 		pixels[index2] = temp;
 	}
 
-	//V4 * rowHDR = job->bitmap;
+	// accumulate into a tile-local buffer, commit it in one go when the tile is done
+	int tileSize = job->framebuffer->tileSize;
+	V4 * tile = TRACKED_NEW(MEMORY_SCRATCH, V4, tileSize * tileSize);
+	memset(tile, 0, tileSize * tileSize * sizeof(V4));
+	V4 * costTile = nullptr;
+	if(job->heatmap)
+	{
+		costTile = TRACKED_NEW(MEMORY_SCRATCH, V4, tileSize * tileSize);
+		memset(costTile, 0, tileSize * tileSize * sizeof(V4));
+	}
+
 	for(int i = 0; i < pixelCount; ++i)
 	{
 		int x = pixels[i].x;
 		int y = pixels[i].y;
 		V4 outgoingRadiance = {};
+		uint64 startCycles = costTile ? GetCycles() : 0;
+		uint64 startRays = costTile ? GetLocalRayCount() : 0;
 
-		for(int s = 0; s < job->spp; ++s)
+		for(int s = 0; s < spp; ++s)
 		{
-			V2 sampleOffset = sampleGrid[job->spp][s];
+			V2 sampleOffset = sampleGrid[spp][s];
 			V3 camRight = -Cross(job->camera->direction, job->camera->up);
 			V3 target = job->camera->position + job->camera->direction*job->camera->focalLength + camRight*(x - job->viewportWidth/2 + sampleOffset.x)*mpp + -job->camera->up*(y - job->viewportHeight/2 + sampleOffset.y)*mpp;
 			V3 dir = Normalize(target - job->camera->position);
@@ -79,16 +155,90 @@ PROFILED_FUNCTION;
 			ray.o = job->camera->position;
 			ray.d = dir;
 
-			V4 sampleRadiance = ComputeRadiance(ray, &scene, 0, 0);
+			V4 sampleRadiance = ComputeRadiance<MaxBounces, SecondaryRays>(ray, job->scene, 0, 0);
 			outgoingRadiance = outgoingRadiance + sampleRadiance;
 		}
 
-		outgoingRadiance = outgoingRadiance / (float)job->spp;
-		//*(rowHDR + x) =
-		PutPixel(job->bitmap, x, y, outgoingRadiance);
+		outgoingRadiance = outgoingRadiance / (float)spp;
+		PutPixel(tile, tileSize, x - job->x0, y - job->y0, outgoingRadiance);
+
+		if(costTile)
+		{
+			float cycles = (float)(GetCycles() - startCycles);
+			float rays = (float)(GetLocalRayCount() - startRays);
+			PutPixel(costTile, tileSize, x - job->x0, y - job->y0, V4{cycles, rays, rays > 0 ? cycles / rays : 0.0f, 1.0f});
+		}
 	}
 
-	delete[] pixels;
+	CommitTile(job->framebuffer, job->tileX, job->tileY, tile);
+	if(costTile)
+	{
+		CommitTile(job->heatmap, job->tileX, job->tileY, costTile);
+		TRACKED_DELETE(MEMORY_SCRATCH, costTile, tileSize * tileSize);
+	}
+	if(job->display)
+	{
+		ResolveTile(job->display, tile, tileSize, job->x0, job->y0, job->x1, job->y1);
+	}
+	if(job->imageWriter)
+	{
+		WriteImageTile(job->imageWriter, job->tileX, job->tileY, tile);
+	}
+	if(job->checkpoint)
+	{
+		MarkTileDone(job->checkpoint, job->tileY * job->framebuffer->tilesX + job->tileX, job->seed);
+	}
+
+	TRACKED_DELETE(MEMORY_SCRATCH, tile, tileSize * tileSize);
+	TRACKED_DELETE(MEMORY_SCRATCH, pixels, maxPixelCount);
+}
+
+struct RenderKernelEntry
+{
+	int spp;
+	int maxBounces;
+	int secondaryRays;
+	RenderKernel kernel;
+};
+
+#define RENDER_KERNEL(spp, bounces, rays) {spp, bounces, rays, RenderTile<spp, bounces, rays>}
+
+// NOTE: specializations for the common configurations, so the per-sample loops and the
+// secondary ray arrays get compile-time sizes. Anything else goes through the runtime kernel.
+// Secondary ray count doesn't matter without diffuse bounces, hence RUNTIME_PARAMETER there.
+RenderKernelEntry renderKernels[] = {
+	RENDER_KERNEL(1, 0, RUNTIME_PARAMETER),
+	RENDER_KERNEL(4, 0, RUNTIME_PARAMETER),
+	RENDER_KERNEL(1, 1, 8*8),
+	RENDER_KERNEL(1, 1, 16*16),
+	RENDER_KERNEL(1, 1, 30*30),
+	RENDER_KERNEL(4, 1, 8*8),
+	RENDER_KERNEL(4, 1, 16*16),
+	RENDER_KERNEL(4, 1, 30*30),
+	RENDER_KERNEL(1, 2, 8*8),
+	RENDER_KERNEL(1, 2, 16*16),
+	RENDER_KERNEL(4, 2, 8*8),
+	RENDER_KERNEL(4, 2, 16*16),
+};
+
+RenderKernel SelectRenderKernel(RenderSettings * settings)
+{
+	for(int i = 0; i < sizeof(renderKernels)/sizeof(renderKernels[0]); ++i)
+	{
+		RenderKernelEntry * entry = &renderKernels[i];
+		if(entry->spp == settings->samplesPerPixel &&
+		   entry->maxBounces == settings->maxDiffuseBounces &&
+		   (entry->secondaryRays == RUNTIME_PARAMETER || entry->secondaryRays == settings->secondaryRays))
+		{
+			return entry->kernel;
+		}
+	}
+	return RenderTile<RUNTIME_PARAMETER, RUNTIME_PARAMETER, RUNTIME_PARAMETER>;
+}
+
+void PerformRenderJob(RenderJob * job)
+{
+	job->kernel(job);
 }
 
 DWORD WINAPI RenderThreadFunc(LPVOID param)
@@ -98,19 +248,22 @@ DWORD WINAPI RenderThreadFunc(LPVOID param)
 	char buffer[256];
 	wsprintf(buffer, "Thread %d started.\n", task->threadId);
 	OutputDebugString(buffer);
+	TRACE_SCOPE("Worker");
 
 	bool hasTasks = true;
 	while(hasTasks)
 	{
 		LONG jobIndex = InterlockedDecrement(&task->jobQueue->jobCount);
-		if(jobIndex > 0)
+		if(jobIndex >= 0)
 		{
 			char buffer1[256];
 			wsprintf(buffer1, "Thread %d taking job %d.\n", task->threadId, jobIndex);
 			OutputDebugString(buffer1);
 
 			RenderJob * job = &task->jobQueue->jobs[jobIndex];
+			uint64 jobStartTime = GetHiresTime();
 			PerformRenderJob(job);
+			RecordTileMetrics(task->threadId, (LONG64)(job->x1 - job->x0) * (job->y1 - job->y0) * job->spp, jobStartTime, GetHiresTime());
 		}
 		else
 		{
@@ -123,3 +276,37 @@ DWORD WINAPI RenderThreadFunc(LPVOID param)
 	OutputDebugString(buffer2);
 	return 0;
 }
+
+// NOTE: threads start suspended so their id is mapped before they profile or trace anything
+void StartRenderThreads(AsyncTask * tasks, HANDLE * threads, int threadCount, JobQueue * queue)
+{
+	for(int i = 0; i < threadCount; ++i)
+	{
+		tasks[i].threadId = i;
+		tasks[i].jobQueue = queue;
+		threads[i] = CreateThread(
+			NULL,
+			0,
+			RenderThreadFunc,
+			&tasks[i],
+			CREATE_SUSPENDED,
+			&tasks[i].systemId
+		);
+		char threadName[TRACE_THREAD_NAME_MAX_LENGTH];
+		_snprintf(threadName, sizeof(threadName), "Render thread %d", i);
+		SetTraceThreadName(gThreadCounter, threadName);
+		gThreadIdMap[tasks[i].systemId] = gThreadCounter++;
+	}
+	for(int i = 0; i < threadCount; ++i)
+	{
+		ResumeThread(threads[i]);
+	}
+}
+
+// Empties the queue so the threads stop after the tile they are on, and waits for them.
+// Needed before freeing anything the jobs use when the render is cut short.
+void StopRenderThreads(HANDLE * threads, int threadCount, JobQueue * queue)
+{
+	InterlockedExchange(&queue->jobCount, 0);
+	WaitForMultipleObjects(threadCount, threads, true, INFINITE);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+// Timeline of what every thread was doing, written as Chrome Trace Event JSON
+// (chrome://tracing, ui.perfetto.dev). Unlike the profile, which only keeps totals,
+// every traced scope is kept as one complete ("X") event, so idle gaps, stragglers
+// and load imbalance between render threads show up directly.
+//
+// NOTE: each thread appends to its own ring buffer and is the only writer of it, so
+// recording needs no locks or atomics. When a ring is full the oldest events are
+// overwritten. The rings are only read after the threads that own them have finished.
+
+// traced scopes are per tile or coarser, so they are on with the coarse profile tier
+#if PROFILE_LEVEL > PROFILE_LEVEL_OFF
+#define TRACE 1
+#endif
+
+#define MAX_TRACE_EVENTS (1<<13)
+#define TRACE_THREAD_NAME_MAX_LENGTH 32
+
+struct TraceEvent
+{
+	const char * name; // must be a string literal
+	uint64 start;
+	uint64 duration;
+	int32 x; // tile coordinates, -1 when not a tile event
+	int32 y;
+};
+
+struct __declspec(align(CACHE_LINE_SIZE)) TraceThreadBuffer
+{
+	TraceEvent events[MAX_TRACE_EVENTS];
+	uint64 eventCount; // total ever recorded, the ring holds the last MAX_TRACE_EVENTS
+	char name[TRACE_THREAD_NAME_MAX_LENGTH];
+};
+
+TraceThreadBuffer traceBuffers[PROGRAM_THREAD_COUNT];
+uint64 traceStartTime;
+double traceCountsPerUs;
+
+void InitTrace_()
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	traceCountsPerUs = (double)freq.QuadPart / 1000000.0;
+	traceStartTime = GetHiresTime();
+}
+
+// called by the thread that creates the named thread, before it starts running
+void SetTraceThreadName_(int threadIndex, const char * name)
+{
+	strncpy(traceBuffers[threadIndex].name, name, TRACE_THREAD_NAME_MAX_LENGTH - 1);
+}
+
+inline void RecordTraceEvent(const char * name, uint64 start, uint64 end, int x = -1, int y = -1)
+{
+	TraceThreadBuffer * buffer = &traceBuffers[LOCAL_THREAD_ID];
+	TraceEvent * event = &buffer->events[buffer->eventCount % MAX_TRACE_EVENTS];
+	event->name = name;
+	event->start = start;
+	event->duration = end - start;
+	event->x = x;
+	event->y = y;
+	buffer->eventCount++;
+}
+
+struct TraceScope
+{
+	TraceScope(const char * name, int x = -1, int y = -1) : name(name), x(x), y(y)
+	{
+		start = GetHiresTime();
+	}
+
+	~TraceScope()
+	{
+		RecordTraceEvent(name, start, GetHiresTime(), x, y);
+	}
+
+	const char * name;
+	uint64 start;
+	int x;
+	int y;
+};
+
+bool WriteTraceJSON_(const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if(!file)
+	{
+		OutputDebugStringA("Failed to write trace!");
+		return false;
+	}
+
+	uint64 droppedCount = 0;
+	bool first = true;
+	fprintf(file, "{\"traceEvents\": [\n");
+	for(int t = 0; t < gThreadCounter; ++t)
+	{
+		TraceThreadBuffer * buffer = &traceBuffers[t];
+		if(buffer->name[0])
+		{
+			fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+					first ? "" : ",\n", t, buffer->name);
+			fprintf(file, ",\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"sort_index\": %d}}", t, t);
+			first = false;
+		}
+
+		uint64 firstEvent = buffer->eventCount > MAX_TRACE_EVENTS ? buffer->eventCount - MAX_TRACE_EVENTS : 0;
+		droppedCount += firstEvent;
+		for(uint64 i = firstEvent; i < buffer->eventCount; ++i)
+		{
+			TraceEvent * event = &buffer->events[i % MAX_TRACE_EVENTS];
+			double ts = (double)(event->start - traceStartTime) / traceCountsPerUs;
+			double dur = (double)event->duration / traceCountsPerUs;
+			fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+					first ? "" : ",\n", event->name, t, ts, dur);
+			if(event->x >= 0)
+			{
+				fprintf(file, ", \"args\": {\"x\": %d, \"y\": %d}", event->x, event->y);
+			}
+			fprintf(file, "}");
+			first = false;
+		}
+	}
+	fprintf(file, "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"droppedEvents\": %llu}}\n", droppedCount);
+	fclose(file);
+	return true;
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef TRACE
+	#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+	#define TRACE_TILE_SCOPE(name, x, y) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, x, y)
+	#define TRACE_EVENT(name, start, end) RecordTraceEvent(name, start, end)
+	#define InitTrace() InitTrace_()
+	#define SetTraceThreadName(index, name) SetTraceThreadName_(index, name)
+	#define WriteTraceJSON(path) WriteTraceJSON_(path)
+#else
+	#define TRACE_SCOPE(name)
+	#define TRACE_TILE_SCOPE(name, x, y)
+	#define TRACE_EVENT(name, start, end)
+	#define InitTrace()
+	#define SetTraceThreadName(index, name)
+	#define WriteTraceJSON(path)
+#endif